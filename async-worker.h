@@ -7,70 +7,156 @@
 #include <algorithm>
 #include <iterator>
 #include <thread>
-#include <deque>
 #include <map>
-#include <mutex>
+#include <vector>
 #include <chrono>
-#include <condition_variable>
+#include <atomic>
 #include <nan.h>
+#include "consts.h"
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 typedef std::map<std::string, std::string> MessageValues;
 
 struct Message {
   std::string name;
   MessageValues values;
+  uint64_t result_seq = 0; // number of results sent before this message (set by sendToNode)
+  Message() {}
   Message(std::string name, MessageValues values) : name(name), values(values) {}
 };
 
-template<typename T> class MessageQueue {
-  std::mutex              m_mutex;
-  std::condition_variable m_cond;
-  std::deque<T>           m_buff;
+// fixed layout share record sent to Node in binary "results" batches
+struct ResultRecord {
+  uint32_t nonce;    // nonce as it is stored in the input blob
+  uint32_t job_slot; // job_slot job key value
+  uint8_t  hash[HASH_LEN];
+};
+static_assert(sizeof(ResultRecord) == 40, "ResultRecord layout is also decoded in index.js");
+
+// result record with its send order among all results (to order it with messages)
+struct QueuedResult {
+  uint64_t seq;
+  ResultRecord record;
+};
+
+// bounded lock-free single producer single consumer ring (several producers need external lock)
+template<typename T, unsigned SIZE> class MessageQueue {
+  static_assert((SIZE & (SIZE - 1)) == 0, "MessageQueue size should be power of 2");
+
+  alignas(64) std::atomic<uint32_t> m_head;       // next slot to read (changed by consumer only)
+  alignas(64) std::atomic<uint32_t> m_tail;       // next slot to write (changed by producer only)
+  alignas(64) std::atomic<bool>     m_is_waiting; // consumer sleeps in wait() on m_tail change
+  T m_buff[SIZE];
 
   public:
 
-  void write(T data) {
-    while (true) {
-      std::unique_lock<std::mutex> locker(m_mutex);
-      m_buff.push_back(data);
-      locker.unlock();
-      m_cond.notify_all();
-      return;
+  MessageQueue() : m_head(0), m_tail(0), m_is_waiting(false) {}
+
+  // returns false if queue is full
+  bool try_write(T&& data) {
+    const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == SIZE) return false;
+    m_buff[tail & (SIZE - 1)] = std::move(data);
+    m_tail.store(tail + 1);
+    if (m_is_waiting.load()) {
+#if defined(__linux__)
+      syscall(SYS_futex, reinterpret_cast<uint32_t*>(&m_tail), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#endif
     }
+    return true;
   }
 
-  T read() {
-    while (true) {
-      std::unique_lock<std::mutex> locker(m_mutex);
-      m_cond.wait(locker, [this]() { return m_buff.size() > 0; });
-      T back = m_buff.front();
-      m_buff.pop_front();
-      locker.unlock();
-      m_cond.notify_all();
-      return back;
-    }
+  // waits for consumer if queue is full
+  void write(T&& data) {
+    while (!try_write(std::move(data))) std::this_thread::yield();
+  }
+
+  // returns false if queue is empty
+  bool read(T& data) {
+    const uint32_t head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load()) return false;
+    data = std::move(m_buff[head & (SIZE - 1)]);
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
   }
 
-  void readAll(std::deque<T>& target) {
-    std::unique_lock<std::mutex> locker(m_mutex);
-    std::copy(m_buff.begin(), m_buff.end(), std::back_inserter(target));
-    m_buff.clear();
-    locker.unlock();
+  // blocks consumer till queue is not empty or timeout_ms (negative for infinite wait) is passed
+  void wait(const int timeout_ms = -1) {
+    const uint32_t tail = m_tail.load();
+    if (m_head.load(std::memory_order_relaxed) != tail || timeout_ms == 0) return;
+#if defined(__linux__)
+    struct timespec timeout = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+    m_is_waiting.store(true);
+    // futex returns at once if m_tail was already changed after the check above
+    syscall(
+      SYS_futex, reinterpret_cast<uint32_t*>(&m_tail), FUTEX_WAIT_PRIVATE, tail,
+      timeout_ms < 0 ? nullptr : &timeout, nullptr, 0
+    );
+    m_is_waiting.store(false);
+#else
+    std::this_thread::sleep_for(std::chrono::milliseconds(
+      timeout_ms < 0 || timeout_ms > 2 ? 2 : timeout_ms
+    ));
+#endif
   }
 };
 
+const unsigned FROM_NODE_QUEUE_SIZE = 256;
+const unsigned TO_NODE_QUEUE_SIZE   = 4096;
+const unsigned RESULT_QUEUE_NUM     = 256; // max number of threads that can send results
+const unsigned RESULT_QUEUE_SIZE    = 64;
+
 class AsyncWorker: public Nan::AsyncProgressQueueWorker<char> {
   Nan::Callback* const  m_progress;
   Nan::Callback* const  m_error_callback;
-  MessageQueue<Message> m_toNode;
+  MessageQueue<Message, TO_NODE_QUEUE_SIZE> m_toNode;
+  MessageQueue<QueuedResult, RESULT_QUEUE_SIZE> m_toNodeResults[RESULT_QUEUE_NUM]; // one per thread
+  std::vector<Message>      m_messages;     // messages drain buffer
+  std::vector<QueuedResult> m_queued;       // results drain buffer (sorted by seq)
+  std::vector<ResultRecord> m_results;      // results batch buffer
+  std::atomic<uint64_t>     m_result_seq;   // number of results sent to m_toNodeResults
+  std::atomic<bool>     m_is_drain_pending; // progress callback will drain m_toNode*
+
+  // sends m_queued results from *pos with seq below end_seq as one "results" batch
+  void callResults(size_t* const pos, const uint64_t end_seq) {
+    m_results.clear();
+    for (; *pos != m_queued.size() && m_queued[*pos].seq < end_seq; ++ *pos)
+      m_results.push_back(m_queued[*pos].record);
+    if (m_results.empty()) return;
+    v8::Local<v8::Value> argv[] = {
+      Nan::New<v8::String>("results").ToLocalChecked(),
+      Nan::CopyBuffer(
+        reinterpret_cast<const char*>(m_results.data()), m_results.size() * sizeof(ResultRecord)
+      ).ToLocalChecked()
+    };
+    m_progress->Call(2, argv, async_resource);
+  }
 
+  // results and messages are passed to Node in the order they were sent (results sent before a
+  // message are visible here after the message is read so messages are read first)
   void drainQueue() {
     Nan::HandleScope scope;
     auto ctx = v8::Isolate::GetCurrent()->GetCurrentContext();
-    std::deque<Message> contents;
-    m_toNode.readAll(contents);
-
-    for (const Message& msg : contents) {
+    m_is_drain_pending.store(false); // messages written after this need new progress callback
+
+    m_messages.clear();
+    Message msg;
+    while (m_toNode.read(msg)) m_messages.push_back(std::move(msg));
+
+    m_queued.clear();
+    QueuedResult result;
+    for (auto& results : m_toNodeResults) while (results.read(result)) m_queued.push_back(result);
+    std::sort(m_queued.begin(), m_queued.end(), [](const QueuedResult& a, const QueuedResult& b) {
+      return a.seq < b.seq;
+    });
+
+    size_t pos = 0;
+    for (const Message& msg : m_messages) {
+      callResults(&pos, msg.result_seq);
       v8::Local<v8::Object> values = Nan::New<v8::Object>();
       for (auto pi = msg.values.begin(); pi != msg.values.end(); ++ pi) {
         values->Set(
@@ -84,6 +170,7 @@ class AsyncWorker: public Nan::AsyncProgressQueueWorker<char> {
       };
       m_progress->Call(2, argv, async_resource);
     }
+    callResults(&pos, UINT64_MAX);
   }
 
   void HandleErrorCallback() {
@@ -104,22 +191,40 @@ class AsyncWorker: public Nan::AsyncProgressQueueWorker<char> {
 
   protected:
 
+  // needs external lock if it is called from several threads
   void sendToNode(
-    const AsyncProgressQueueWorker<char>::ExecutionProgress& progress, const Message& msg
+    const AsyncProgressQueueWorker<char>::ExecutionProgress& progress, Message&& msg
   ) {
-    m_toNode.write(msg);
-    progress.Send(reinterpret_cast<const char*>(&m_toNode), sizeof(m_toNode));
+    msg.result_seq = m_result_seq.load();
+    m_toNode.write(std::move(msg));
+    notifyNode(progress);
+  }
+
+  // lock-free if each thread uses its own queue_id
+  void sendResultToNode(
+    const AsyncProgressQueueWorker<char>::ExecutionProgress& progress, const unsigned queue_id,
+    const ResultRecord& result
+  ) {
+    QueuedResult result2 = { m_result_seq.fetch_add(1), result };
+    m_toNodeResults[queue_id].write(std::move(result2));
+    notifyNode(progress);
+  }
+
+  void notifyNode(const AsyncProgressQueueWorker<char>::ExecutionProgress& progress) {
+    static const char progress_data = 0; // not used by HandleProgressCallback
+    if (!m_is_drain_pending.exchange(true)) progress.Send(&progress_data, sizeof(progress_data));
   }
 
   public:
 
-  MessageQueue<Message> fromNode;
+  MessageQueue<Message, FROM_NODE_QUEUE_SIZE> fromNode;
 
   AsyncWorker(
     Nan::Callback* const progress, Nan::Callback* const callback,
     Nan::Callback* const error_callback
   ) : Nan::AsyncProgressQueueWorker<char>(callback, "moner-core::AsyncWorker"),
-      m_progress(progress), m_error_callback(error_callback) {}
+      m_progress(progress), m_error_callback(error_callback), m_result_seq(0),
+      m_is_drain_pending(false) {}
 
   ~AsyncWorker() {
     delete m_progress;
@@ -173,8 +278,9 @@ class AsyncWorkerWrapper: public Nan::ObjectWrap {
       const auto& value = Nan::Utf8String(obj->Get(ctx, key).ToLocalChecked());
       values[*key2] = *value;
     }
-    Nan::ObjectWrap::Unwrap<AsyncWorkerWrapper>(info.Holder())->
-      m_worker->fromNode.write(Message(*name, values));
+    if (!Nan::ObjectWrap::Unwrap<AsyncWorkerWrapper>(info.Holder())->
+         m_worker->fromNode.try_write(Message(*name, values))
+    ) Nan::ThrowError("Compute core message queue is full");
   }
 
   static inline Nan::Persistent<v8::Function>& constructor() {
@@ -0,0 +1,78 @@
+// Copyright GNU GPLv3 (c) 2023-2025 MoneroOcean <support@moneroocean.stream>
+
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include "numa-nodes.h"
+
+// order of logical CPUs for hashing threads read from /sys/devices/system/cpu: one CPU of each
+// physical core first, then their SMT siblings, cores that share L3 cache are next to each other.
+// CPUs are in their number order on other platforms or if this topology is not available.
+class CpuTopology {
+  std::vector<unsigned> m_order;
+
+  static std::string read_line(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+  }
+
+  public:
+
+  CpuTopology() {
+    const unsigned cpu_num = std::max(std::thread::hardware_concurrency(), 1u);
+    // (SMT sibling index, first CPU of L3 cache, CPU)
+    std::vector<std::tuple<unsigned, unsigned, unsigned> > cpus;
+    for (unsigned cpu = 0; cpu != cpu_num; ++cpu) {
+      unsigned smt = 0, l3 = 0;
+#if defined(__linux__)
+      const std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+      const std::vector<unsigned> siblings =
+        NumaNodes::parse_cpu_list(read_line(path + "/topology/thread_siblings_list"));
+      smt = std::find(siblings.begin(), siblings.end(), cpu) - siblings.begin();
+      if (smt == siblings.size()) smt = 0;
+      for (unsigned index = 0; ; ++index) {
+        const std::string cache_path = path + "/cache/index" + std::to_string(index);
+        const std::string level = read_line(cache_path + "/level");
+        if (level.empty()) break;
+        if (level != "3") continue;
+        const std::vector<unsigned> l3_cpus =
+          NumaNodes::parse_cpu_list(read_line(cache_path + "/shared_cpu_list"));
+        if (!l3_cpus.empty()) l3 = l3_cpus[0];
+        break;
+      }
+#endif
+      cpus.emplace_back(smt, l3, cpu);
+    }
+    std::sort(cpus.begin(), cpus.end());
+    for (const auto& cpu : cpus) m_order.push_back(std::get<2>(cpu));
+  }
+
+  inline const std::vector<unsigned>& order() const { return m_order; }
+
+  // CPUs of count threads that start from thread offset of all threads in auto order or CPUs
+  // from explicit "0-3:8-11" style list (it is repeated if there are more threads)
+  std::vector<unsigned> get_cpus(
+    const std::string& cpu_list, const unsigned offset, const unsigned count
+  ) const {
+    std::string cpu_list2 = cpu_list;
+    std::replace(cpu_list2.begin(), cpu_list2.end(), ':', ',');
+    std::vector<unsigned> list;
+    try {
+      list = NumaNodes::parse_cpu_list(cpu_list2, m_order.size()); // only CPUs of this host
+    } catch (...) {
+      throw std::string("Bad CPU list");
+    }
+    if (!cpu_list.empty() && list.empty()) throw std::string("Bad CPU list");
+    std::vector<unsigned> cpus;
+    for (unsigned i = 0; i != count; ++i)
+      cpus.push_back(list.empty() ? m_order[(offset + i) % m_order.size()] : list[i % list.size()]);
+    return cpus;
+  }
+};
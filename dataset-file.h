@@ -0,0 +1,77 @@
+// Copyright GNU GPLv3 (c) 2023-2025 MoneroOcean <support@moneroocean.stream>
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+// file with memory blocks (like rx cache and dataset) and their checksum that is written once
+// to be read straight into (huge page) memory by later process starts
+class DatasetFile {
+  static const uint64_t MAGIC = 0x5346445841525846ULL;
+
+  struct Header {
+    uint64_t magic;
+    uint64_t size; // of all blocks
+    uint64_t checksum;
+  };
+
+  public:
+
+  struct Block {
+    uint8_t* mem;
+    size_t   size;
+  };
+
+  // fast non cryptographic checksum (4 independent lanes to hide multiply latency)
+  static uint64_t checksum(const std::vector<Block>& blocks) {
+    uint64_t h[4] = { 0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL, 0x27D4EB2F165667C5ULL };
+    for (const auto& block : blocks) {
+      const uint64_t* const words = reinterpret_cast<const uint64_t*>(block.mem);
+      const size_t word_num = block.size / sizeof(uint64_t); // block sizes are multiple of 32
+      for (size_t i = 0; i < word_num; i += 4) for (unsigned j = 0; j != 4; ++ j) {
+        const uint64_t x = h[j] ^ words[i + j];
+        h[j] = ((x << 29) | (x >> 35)) * 0x9FB21C651E98DF25ULL;
+      }
+    }
+    return h[0] ^ ((h[1] << 16) | (h[1] >> 48)) ^ ((h[2] << 32) | (h[2] >> 32)) ^ ((h[3] << 48) | (h[3] >> 16));
+  }
+
+  // reads all blocks from path if it has exactly their size and right checksum
+  static bool load(const std::string& path, const std::vector<Block>& blocks) {
+    FILE* const file = fopen(path.c_str(), "rb");
+    if (file == nullptr) return false;
+    Header header;
+    uint64_t size = 0;
+    for (const auto& block : blocks) size += block.size;
+    bool is_ok = fread(&header, sizeof(header), 1, file) == 1 && header.magic == MAGIC &&
+                 header.size == size;
+    for (const auto& block : blocks) if (is_ok) is_ok = fread(block.mem, 1, block.size, file) == block.size;
+    fclose(file);
+    return is_ok && header.checksum == checksum(blocks);
+  }
+
+  // writes all blocks to path (via temporary file so other processes never read partial file)
+  static bool save(const std::string& path, const std::vector<Block>& blocks) {
+#if defined(__linux__)
+    const std::string tmp_path = path + "." + std::to_string(getpid()) + ".tmp";
+#else
+    const std::string tmp_path = path + ".tmp";
+#endif
+    FILE* const file = fopen(tmp_path.c_str(), "wb");
+    if (file == nullptr) return false;
+    Header header = { MAGIC, 0, checksum(blocks) };
+    for (const auto& block : blocks) header.size += block.size;
+    bool is_ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (const auto& block : blocks) if (is_ok) is_ok = fwrite(block.mem, 1, block.size, file) == block.size;
+    if (fclose(file) != 0) is_ok = false;
+    if (is_ok) is_ok = rename(tmp_path.c_str(), path.c_str()) == 0;
+    if (!is_ok) remove(tmp_path.c_str());
+    return is_ok;
+  }
+};
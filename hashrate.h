@@ -0,0 +1,90 @@
+// Copyright GNU GPLv3 (c) 2023-2025 MoneroOcean <support@moneroocean.stream>
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+const unsigned MAX_HASHRATE_THREADS     = 256;
+const unsigned HASHRATE_SAMPLE_INTERVAL = 1000;      // ms between counter samples
+const unsigned HASHRATE_SAMPLE_NUM      = 15*60 + 1; // samples to cover the longest (15 min) window
+
+// per thread lock-free hash counters and their sample ring for sliding window hashrates
+class Hashrate {
+  // each counter is changed by its own thread only and is in its own cache line
+  struct alignas(64) Counter {
+    std::atomic<uint64_t> value;
+    Counter() : value(0) {}
+  };
+
+  Counter  m_counters[MAX_HASHRATE_THREADS];
+  unsigned m_thread_num, m_sample_pos, m_sample_count;
+  std::vector<uint64_t> m_timestamps; // sample timestamps (ms)
+  std::vector<uint64_t> m_samples;    // sample thread counters followed by their total
+
+  inline uint64_t sample(const unsigned pos, const unsigned thread_id) const {
+    return m_samples[pos * (m_thread_num + 1) + thread_id];
+  }
+
+  public:
+
+  static const unsigned TOTAL = MAX_HASHRATE_THREADS; // thread_id to get all threads hashrate
+
+  Hashrate() { reset(0, 0); }
+
+  // called from thread_id thread only
+  inline void add(const unsigned thread_id, const uint64_t count = 1) {
+    std::atomic<uint64_t>& value = m_counters[thread_id].value;
+    value.store(value.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+  }
+
+  // functions below are called from one (compute) thread while counting threads are stopped
+  void reset(const unsigned thread_num, const uint64_t timestamp) {
+    m_thread_num   = thread_num;
+    m_sample_pos   = 0;
+    m_sample_count = 0;
+    m_timestamps.assign(HASHRATE_SAMPLE_NUM, 0);
+    m_samples.assign(HASHRATE_SAMPLE_NUM * (thread_num + 1), 0);
+    for (auto& counter : m_counters) counter.value.store(0, std::memory_order_relaxed);
+    sample(timestamp, true);
+  }
+
+  inline unsigned thread_num() const { return m_thread_num; }
+
+  // functions below are called from one (compute) thread while counting threads can run
+  uint64_t count(const unsigned thread_id = TOTAL) const {
+    if (thread_id != TOTAL) return m_counters[thread_id].value.load(std::memory_order_relaxed);
+    uint64_t total = 0;
+    for (unsigned i = 0; i != m_thread_num; ++ i)
+      total += m_counters[i].value.load(std::memory_order_relaxed);
+    return total;
+  }
+
+  // stores counters if HASHRATE_SAMPLE_INTERVAL passed after the last sample
+  void sample(const uint64_t timestamp, const bool is_force = false) {
+    if (!is_force && m_sample_count && timestamp - m_timestamps[
+      (m_sample_pos + HASHRATE_SAMPLE_NUM - 1) % HASHRATE_SAMPLE_NUM
+    ] < HASHRATE_SAMPLE_INTERVAL) return;
+    uint64_t* const samples = m_samples.data() + m_sample_pos * (m_thread_num + 1);
+    samples[m_thread_num] = 0;
+    for (unsigned i = 0; i != m_thread_num; ++ i)
+      samples[m_thread_num] += samples[i] = m_counters[i].value.load(std::memory_order_relaxed);
+    m_timestamps[m_sample_pos] = timestamp;
+    m_sample_pos = (m_sample_pos + 1) % HASHRATE_SAMPLE_NUM;
+    if (m_sample_count < HASHRATE_SAMPLE_NUM) ++ m_sample_count;
+  }
+
+  // H/s over the last window_ms (or shorter time if there are no such old samples yet)
+  float get(const uint64_t window_ms, const unsigned thread_id = TOTAL) const {
+    if (m_sample_count < 2) return 0.0f;
+    const unsigned last = (m_sample_pos + HASHRATE_SAMPLE_NUM - 1) % HASHRATE_SAMPLE_NUM;
+    unsigned first = last;
+    for (unsigned i = 1; i != m_sample_count; ++ i) {
+      first = (last + HASHRATE_SAMPLE_NUM - i) % HASHRATE_SAMPLE_NUM;
+      if (m_timestamps[last] - m_timestamps[first] >= window_ms) break;
+    }
+    const unsigned column = thread_id == TOTAL ? m_thread_num : thread_id;
+    return static_cast<float>(sample(last, column) - sample(first, column)) /
+           (m_timestamps[last] - m_timestamps[first]) * 1000.0f;
+  }
+};
@@ -0,0 +1,63 @@
+// Copyright GNU GPLv3 (c) 2023-2025 MoneroOcean <support@moneroocean.stream>
+
+#pragma once
+
+#include <mutex>
+#include <set>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// registered threads use idle priority (so they do not slow down hashing threads) until they are
+// switched back to normal priority from another thread (unlike nice value it needs no privileges)
+class IdleThreads {
+  std::mutex m_mutex;
+  bool m_is_idle;
+#if defined(__linux__)
+  std::set<pthread_t> m_threads;
+
+  static void set_priority(const pthread_t thread, const bool is_idle) {
+    const sched_param param = {};
+    pthread_setschedparam(thread, is_idle ? SCHED_IDLE : SCHED_OTHER, &param);
+  }
+#endif
+
+  public:
+
+  IdleThreads() : m_is_idle(false) {}
+
+  // registers the calling thread while it is in scope (does nothing for nullptr)
+  class Guard {
+    IdleThreads* const m_idle_threads;
+
+    public:
+
+    Guard(IdleThreads* const idle_threads) : m_idle_threads(idle_threads) {
+#if defined(__linux__)
+      if (!m_idle_threads) return;
+      std::lock_guard<std::mutex> lock(m_idle_threads->m_mutex);
+      m_idle_threads->m_threads.insert(pthread_self());
+      set_priority(pthread_self(), m_idle_threads->m_is_idle);
+#endif
+    }
+    ~Guard() {
+#if defined(__linux__)
+      if (!m_idle_threads) return;
+      std::lock_guard<std::mutex> lock(m_idle_threads->m_mutex);
+      m_idle_threads->m_threads.erase(pthread_self());
+      // pool threads are reused for other work
+      if (m_idle_threads->m_is_idle) set_priority(pthread_self(), false);
+#endif
+    }
+  };
+
+  void set_idle(const bool is_idle) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_is_idle == is_idle) return;
+    m_is_idle = is_idle;
+#if defined(__linux__)
+    for (const auto thread : m_threads) set_priority(thread, is_idle);
+#endif
+  }
+};
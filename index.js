@@ -10,15 +10,33 @@ const fs      = require('fs');
 const thread_id = cluster.isMaster ? "master" : parseInt(process.env["thread_id"]);
 let worker_ids = []; // active worker ids (cluster.workers can contain not yet closed workers)
 
+const RESULT_RECORD_SIZE = 40;  // ResultRecord size from async-worker.h
+const MAX_JOB_SLOTS      = 256; // job_slot values that map binary results to job ids
+
 module.exports.create_core = function() {
   const deploy_path = path.join(__dirname, "./fast-rx.node");
   const core_path   = fs.existsSync(deploy_path) ? deploy_path :
                       path.join(__dirname, "/build/Release/fast-rx.node");
   const core_module = require(core_path);
-  let emitter = new events();
+  let emitter   = new events();
+  let job_slot  = 0;
+  let job_slots = []; // job ids by job_slot
   let worker = new core_module.AsyncWorker(
+    // "results" batches and messages are emitted in the order the core sent them
     function(name, value) {
-      emitter.emit(name, value);
+      if (name !== "results") return emitter.emit(name, value);
+      // binary batch of {uint32 nonce, uint32 job_slot, uint8[32] hash} share records
+      emitter.emit("results", value);
+      for (let pos = 0; pos + RESULT_RECORD_SIZE <= value.length; pos += RESULT_RECORD_SIZE) {
+        const job = job_slots[value.readUInt32LE(pos + 4)];
+        emitter.emit("result", {
+          nonce:     value.toString("hex", pos, pos + 4),
+          hash:      value.toString("hex", pos + 8, pos + RESULT_RECORD_SIZE),
+          pool_id:   job.pool_id,
+          worker_id: job.worker_id,
+          job_id:    job.job_id
+        });
+      }
     },
     function ()     { emitter.emit("close"); },
     function(error) { emitter.emit("error", error); },
@@ -27,7 +45,22 @@ module.exports.create_core = function() {
   return {
     from:    emitter,
     emit_to: function(name, data) {
-      worker.sendToCpp(name, data ? data : {});
+      if (name === "job") {
+        job_slot = (job_slot + 1) % MAX_JOB_SLOTS;
+        job_slots[job_slot] = {
+          pool_id:   "pool_id"   in data ? String(data.pool_id)   : "",
+          worker_id: "worker_id" in data ? String(data.worker_id) : "",
+          job_id:    "job_id"    in data ? String(data.job_id)    : ""
+        };
+        data.job_slot = job_slot;
+      }
+      // full core message queue is reported as core "error" message (it is not thrown from
+      // message handlers of cluster processes that would kill them)
+      try {
+        worker.sendToCpp(name, data ? data : {});
+      } catch (err) {
+        emitter.emit("error", { message: err.message });
+      }
     }
   };
 };
@@ -42,20 +75,29 @@ module.exports.cluster_process = function() {
   function send_msg(type, value) {
     return process.send({type: type, value: value, thread_id: thread_id});
   }
-  compute_core.from.on("test",   function(v) { send_msg("test", v); });
-  compute_core.from.on("result", function(v) { send_msg("result", v); });
-  compute_core.from.on("error",  function(v) { send_msg("error", v); });
-  compute_core.from.on("close",  function()  { process.exit(0); });
+  compute_core.from.on("test",       function(v) { send_msg("test", v); });
+  compute_core.from.on("bench",      function(v) { send_msg("bench", v); });
+  compute_core.from.on("stats",      function(v) { send_msg("stats", v); });
+  compute_core.from.on("result",     function(v) { send_msg("result", v); });
+  compute_core.from.on("hashrate",   function(v) { send_msg("hashrate", v); });
+  compute_core.from.on("last_nonce", function(v) { send_msg("last_nonce", v); });
+  compute_core.from.on("nonce_exhausted", function(v) { send_msg("nonce_exhausted", v); });
+  compute_core.from.on("dataset_progress", function(v) { send_msg("dataset_progress", v); });
+  compute_core.from.on("verify",     function(v) { send_msg("verify", v); });
+  compute_core.from.on("rx_tune",    function(v) { send_msg("rx_tune", v); });
+  compute_core.from.on("msr",        function(v) { send_msg("msr", v); });
+  compute_core.from.on("error",      function(v) { send_msg("error", v); });
+  compute_core.from.on("close",      function()  { process.exit(0); });
 
   // process messages from the master thread
   process.on("message", function(msg) {
     switch (msg.type) {
-      case "job": case "bench": case "test":
+      case "job": case "bench": case "test": case "verify":
         // find dev for this specific thread from msg.job.dev list
         msg.job.thread_id = thread_id;
         compute_core.emit_to(msg.type, msg.job);
         break;
-      case "pause": case "close":
+      case "pause": case "resume": case "stats": case "close":
         compute_core.emit_to(msg.type);
         break;
       default: console.error("Unknown thread message");
@@ -97,8 +139,8 @@ module.exports.get_thread_dev = function(thread_id, devs) {
   return null;
 };
 
-// return dev *batch value
+// return dev *batch value (it can be followed by @CPU list)
 module.exports.get_dev_batch = function(dev) {
-  const m = dev.match(/\*(\d+)$/);
+  const m = dev.match(/\*(\d+)(@[\d:-]+)?$/);
   return m ? parseInt(m[1]) : 1;
 };
@@ -0,0 +1,115 @@
+// Copyright GNU GPLv3 (c) 2023-2025 MoneroOcean <support@moneroocean.stream>
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// hands jobs from one (message) thread to persistent hashing threads without locks. Each job is
+// published with the next sequence number that threads check between hashes (like
+// xmrig::Nonce::isOutdated), so they take the new job right after their current hash. The last
+// JOB_NUM jobs are kept in a ring and a job is deleted only after no thread announces its sequence.
+// Threads can be added up to the max number (threads with ids above job threads skip that job).
+template<typename Job> class JobSlot {
+  static const unsigned JOB_NUM = 4;
+
+  // each state is changed by its own thread only and is in its own cache line
+  struct alignas(64) ThreadState {
+    std::atomic<uint64_t> seq;     // sequence of the job this thread uses (or waits after)
+    std::atomic<bool>     is_busy; // thread has not finished this job yet
+    ThreadState() : seq(0), is_busy(false) {}
+  };
+
+  std::unique_ptr<Job> m_jobs[JOB_NUM]; // job of sequence seq is m_jobs[seq % JOB_NUM]
+  std::atomic<uint64_t> m_seq;          // sequence of the last published job (nullptr stops threads)
+  std::atomic<bool> m_is_exit;
+  const unsigned m_max_thread_num;
+  unsigned m_thread_num; // number of added threads
+  std::unique_ptr<ThreadState[]> m_states;
+
+  // waits until thread states satisfy is_ok(their sequence)
+  template<typename F> void wait_threads(F is_ok) {
+    for (unsigned i = 0; i != m_thread_num; ++ i) {
+      uint64_t seq;
+      while (!is_ok(seq = m_states[i].seq.load())) m_states[i].seq.wait(seq);
+    }
+  }
+
+  public:
+
+  JobSlot(const unsigned max_thread_num)
+    : m_seq(0), m_is_exit(false), m_max_thread_num(max_thread_num), m_thread_num(0),
+      m_states(new ThreadState[max_thread_num]) {}
+
+  // functions below are called from the message thread only
+
+  inline unsigned thread_num() const { return m_thread_num; }
+
+  // returns id of the new thread that needs to call next (it does not use any job before that)
+  unsigned add_thread() {
+    if (m_thread_num == m_max_thread_num) throw std::string("Too many hashing threads");
+    m_states[m_thread_num].seq.store(m_seq.load());
+    return m_thread_num ++;
+  }
+
+  // the last published job (nullptr if threads are stopped)
+  inline Job* current() const { return m_jobs[m_seq.load() % JOB_NUM].get(); }
+
+  // threads switch to the job (or stop after their current hash if it is nullptr)
+  void publish(std::unique_ptr<Job> job) {
+    const uint64_t seq = m_seq.load() + 1;
+    // job of this ring position can still be used by threads that did not finish its hash yet
+    if (seq >= JOB_NUM) wait_threads([=](const uint64_t thread_seq) { return thread_seq != seq - JOB_NUM; });
+    m_jobs[seq % JOB_NUM] = std::move(job);
+    m_seq.store(seq);
+    m_seq.notify_all();
+  }
+
+  // stops threads and waits until they do not use any job
+  void stop() {
+    publish(nullptr);
+    const uint64_t seq = m_seq.load();
+    wait_threads([=](const uint64_t thread_seq) { return thread_seq == seq; });
+  }
+
+  // true if the last job is not finished by some thread yet
+  bool is_active() const {
+    const uint64_t seq = m_seq.load();
+    if (!m_jobs[seq % JOB_NUM]) return false;
+    for (unsigned i = 0; i != m_thread_num; ++ i)
+      if (m_states[i].seq.load() != seq || m_states[i].is_busy.load()) return true;
+    return false;
+  }
+
+  // makes next calls return nullptr so threads can exit
+  void exit() {
+    m_is_exit.store(true);
+    m_seq.fetch_add(1);
+    m_seq.notify_all();
+  }
+
+  // functions below are called from hashing threads
+
+  inline bool is_outdated(const uint64_t seq) const {
+    return m_seq.load(std::memory_order_relaxed) != seq;
+  }
+
+  // waits for a newer job than the job of seq (it is set to the sequence of the returned job),
+  // returns nullptr if threads need to exit
+  Job* next(const unsigned thread, uint64_t& seq) {
+    ThreadState& state = m_states[thread];
+    while (true) {
+      state.is_busy.store(false);
+      m_seq.wait(seq);
+      if (m_is_exit.load()) return nullptr;
+      state.is_busy.store(true);
+      seq = m_seq.load();
+      state.seq.store(seq); // announces that job of seq is used by this thread
+      state.seq.notify_all();
+      if (m_seq.load() != seq) continue; // its ring position could be reused before announce
+      if (Job* const job = m_jobs[seq % JOB_NUM].get()) return job;
+    }
+  }
+};
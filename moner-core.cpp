@@ -1,9 +1,11 @@
 // Copyright GNU GPLv3 (c) 2023-2025 MoneroOcean <support@moneroocean.stream>
 
 #include "moner-core.h"
+#include "msr-presets.h"
 
 #include "3rdparty/fmt/core.h"
 #include "backend/cpu/Cpu.h"
+#include "base/tools/Chrono.h"
 #include "crypto/cn/CnCtx.h"
 #include "crypto/randomx/blake2/blake2.h"
 #include "crypto/randomx/blake2/avx2/blake2b.h"
@@ -33,6 +35,32 @@ bool Core::hex2bin(const char* in, unsigned int len, unsigned char* out) {
   return true;
 }
 
+size_t Core::get_page_size(const xmrig::VirtualMemory* const mem) {
+  return mem->isOneGbPages() ? 1024*1024*1024 : mem->isHugePages() ? 2*1024*1024 : 4096;
+}
+
+// converts target (32-bit compact or 64-bit little endian hex) or difficulty job key to 64-bit target
+uint64_t Core::get_target(const MessageValues& v) {
+  if (v.contains("target")) {
+    const std::string& target_hex = v.at("target");
+    uint8_t target[sizeof(uint64_t)] = {};
+    if (target_hex.size() != sizeof(uint32_t)*2 && target_hex.size() != sizeof(uint64_t)*2)
+      throw std::string("Bad target length");
+    if (!hex2bin(target_hex.c_str(), target_hex.size() >> 1, target))
+      throw std::string("Bad target hex");
+    if (target_hex.size() == sizeof(uint64_t)*2) return *reinterpret_cast<const uint64_t*>(target);
+    const uint32_t target32 = *reinterpret_cast<const uint32_t*>(target);
+    if (!target32) throw std::string("Bad target value");
+    return 0xFFFFFFFFFFFFFFFFULL / (0xFFFFFFFFULL / target32);
+  }
+  if (v.contains("difficulty")) {
+    const uint64_t difficulty = strtoull(v.at("difficulty").c_str(), nullptr, 10);
+    if (!difficulty) throw std::string("Bad difficulty value");
+    return 0xFFFFFFFFFFFFFFFFULL / difficulty;
+  }
+  throw std::string("Missing target or difficulty job key");
+}
+
 std::vector<std::string> Core::tokenize(const std::string& str, const char delim) {
   std::vector<std::string> out;
   size_t start;
@@ -59,10 +87,6 @@ char* Core::hash_bin2hex(const uint8_t* const output, char* hash, const unsigned
   return hash0;
 }
 
-char* Core::hash_bin2hex(char* const hash, const unsigned batch) const {
-  return hash_bin2hex(m_output, hash, batch);
-}
-
 void Core::send_msg(const std::string key, const MessageValues& values) {
   static std::mutex mutex_message;
   mutex_message.lock();
@@ -80,16 +104,14 @@ void Core::send_error(const std::string& str) {
   send_msg("error", "message", str);
 }
 
-void Core::send_result(const uint32_t nonce, const uint8_t* const output) {
-  MessageValues values;
-  char nonce_hex[sizeof(uint32_t)*2+1], hash_hex[HASH_LEN*2+1];
-  snprintf(nonce_hex, sizeof(uint32_t)*2+1, "%08x", __builtin_bswap32(nonce));
-  values["nonce"]     = nonce_hex;
-  values["hash"]      = hash_bin2hex(output, hash_hex);
-  values["pool_id"]   = m_pool_id;
-  values["worker_id"] = m_worker_id;
-  values["job_id"]    = m_job_id;
-  send_msg("result", values);
+void Core::send_result(
+  const uint32_t nonce, const uint8_t* const output, const uint32_t job_slot, const unsigned thread_id
+) {
+  ResultRecord result;
+  result.nonce    = nonce;
+  result.job_slot = job_slot;
+  memcpy(result.hash, output, HASH_LEN);
+  sendResultToNode(*m_progress, thread_id, result);
 }
 
 void Core::send_last_nonce(const uint32_t nonce, const std::string& pool_id) {
@@ -99,7 +121,103 @@ void Core::send_last_nonce(const uint32_t nonce, const std::string& pool_id) {
   send_msg("last_nonce", result);
 }
 
-static void free_mem(void* const mem) { _mm_free(mem); }
+// nonce range of the job has no blocks left (threads stop after their reserved nonces)
+void Core::send_nonce_exhausted(const HashJob& job) {
+  if (!job.nonces->set_exhausted()) return;
+  MessageValues values;
+  values["pool_id"] = job.pool_id;
+  values["job_id"]  = job.job_id;
+  send_msg("nonce_exhausted", values);
+}
+
+void Core::set_first_hash_timestamp() {
+  if (m_first_hash_timestamp.load(std::memory_order_relaxed)) return;
+  uint64_t no_timestamp = 0;
+  m_first_hash_timestamp.compare_exchange_strong(no_timestamp, xmrig::Chrono::steadyMSecs());
+}
+
+// applies (or releases) rx MSR preset of this CPU and reports results of its register writes
+void Core::set_msr(const bool is_msr) {
+  if (is_msr == m_is_msr) return;
+  MessageValues values;
+  values["msr_mod"] = MsrPresets::get_mod_name(ci.msrMod());
+  values["restore"] = is_msr ? "0" : "1";
+  if (is_msr) {
+    try {
+      values["registers"] = MsrPresets::get().apply();
+      m_is_msr = true;
+    } catch (const std::string& err) { // hashing works without MSR preset
+      values["error"] = err;
+    }
+  } else {
+    values["registers"] = MsrPresets::get().release();
+    m_is_msr = false;
+    if (values["registers"].empty()) return; // other cores still use the preset
+  }
+  send_msg("msr", values);
+}
+
+std::string Core::get_cpus_str() const {
+  std::string cpus;
+  for (const unsigned cpu : m_cpus) {
+    if (!cpus.empty()) cpus += " ";
+    cpus += std::to_string(cpu);
+  }
+  return cpus;
+}
+
+void Core::send_bench_result() {
+  const uint64_t timestamp            = xmrig::Chrono::steadyMSecs(),
+                 first_hash_timestamp = m_first_hash_timestamp,
+                 hash_count           = m_hashrate.count();
+  MessageValues values;
+  values["algo"]            = m_algo_str;
+  values["dev"]             = m_dev_str + "*" + std::to_string(m_batch);
+  values["threads"]         = std::to_string(m_threads);
+  values["cpus"]            = get_cpus_str();
+  values["hashrate"]        = std::to_string(first_hash_timestamp && timestamp > first_hash_timestamp ?
+    static_cast<float>(hash_count) / (timestamp - first_hash_timestamp) * 1000.0f : 0.0f
+  );
+  values["first_hash_time"] = std::to_string(
+    first_hash_timestamp ? first_hash_timestamp - m_bench_start : 0
+  );
+  values["dataset_init_time"] = std::to_string(m_rx_dataset_init_time);
+  values["huge_pages"]        = std::to_string(m_lpads && get_page_size(m_lpads) > 4096);
+  values["dataset_huge_pages"] = std::to_string(
+    m_rx_shared_dataset_mem ? m_rx_shared_dataset_mem->is_huge_pages() :
+    m_rx_dataset_mem && get_page_size(m_rx_dataset_mem) > 4096
+  );
+  // page sizes (bytes) that were really used (1 GB and huge pages fall back to smaller ones)
+  values["page_size"]         = std::to_string(m_lpads ? get_page_size(m_lpads) : 0);
+  values["dataset_page_size"] = std::to_string(
+    m_rx_shared_dataset_mem ? (m_rx_shared_dataset_mem->is_huge_pages() ? 2*1024*1024 : 4096) :
+    m_rx_dataset_mem ? get_page_size(m_rx_dataset_mem) : 0
+  );
+  send_msg("bench", values);
+  // stop bench hashing
+  stop_threads();
+  m_bench_end = 0;
+  m_is_paused = false;
+}
+
+void Core::send_stats() {
+  static const std::pair<std::string, uint64_t> windows[] = {
+    { "10s", 10*1000 }, { "60s", 60*1000 }, { "15m", 15*60*1000 }
+  };
+  MessageValues values;
+  for (const auto& window : windows) {
+    std::string thread_hashrates;
+    for (unsigned i = 0; i != m_hashrate.thread_num(); ++ i) {
+      if (i) thread_hashrates += " ";
+      thread_hashrates += std::to_string(m_hashrate.get(window.second, i));
+    }
+    values["threads_" + window.first] = thread_hashrates;
+    values["total_"   + window.first] = std::to_string(m_hashrate.get(window.second));
+  }
+  values["hashes"] = std::to_string(m_hashrate.count());
+  values["cpus"]   = get_cpus_str();
+  send_msg("stats", values);
+}
 
 void Core::free_memory(
   const bool is_batch_changed,
@@ -107,51 +225,115 @@ void Core::free_memory(
   const bool is_free_cn,
   const bool is_free_rx
 ) {
-  // m_thread_pool need to be deleted first if anything rx related is deleted
-  if (is_batch_changed || is_free_rx) {
-    // ++ m_job_ref is to stop rx threads if any
-    if (m_thread_pool) { ++ m_job_ref; delete m_thread_pool; m_thread_pool = nullptr; }
-    if (m_vm) {
-      for (int i = 0; i != m_batch; ++ i) randomx_destroy_vm(m_vm[i]);
-      delete [] m_vm; m_vm = nullptr;
-    }
-  }
+  // hashing threads need to be stopped first if anything they use is deleted
+  if (is_batch_changed || is_mem_size_changed || is_free_cn || is_free_rx) stop_threads();
+  if (is_batch_changed) free_thread_pool();
+  // rx VMs use scratchpads from m_lpads
+  if (is_batch_changed || is_mem_size_changed || is_free_rx) free_rx_vms();
   if (is_batch_changed || is_mem_size_changed) {
     if (m_lpads) { delete m_lpads; m_lpads = nullptr; }
   }
-  if (is_batch_changed) {
-    if (m_input_cn) { free_mem(m_input_cn); m_input_cn = nullptr; }
-    if (m_output)   { free_mem(m_output);   m_output   = nullptr; }
-  }
   if (is_batch_changed || is_mem_size_changed || is_free_cn) {
-    if (m_ctx) { xmrig::CnCtx::release(m_ctx, m_batch); delete [] m_ctx; m_ctx = nullptr; }
-  }
-  if (is_batch_changed || is_free_cn) {
-    if (m_spads) { free_mem(m_spads); m_spads = nullptr; }
+    if (m_ctx) { xmrig::CnCtx::release(m_ctx, m_threads * m_batch); delete [] m_ctx; m_ctx = nullptr; }
   }
   if (is_free_rx) {
+    wait_rx_prep();
+    wait_rx_save();
+    if (m_rx_init_pool) { delete m_rx_init_pool; m_rx_init_pool = nullptr; }
+    free_rx_next();
     if (m_rx_dataset)     { randomx_release_dataset(m_rx_dataset); m_rx_dataset = nullptr; }
     if (m_rx_cache)       { randomx_release_cache(m_rx_cache); m_rx_cache = nullptr; }
     if (m_rx_dataset_mem) { delete m_rx_dataset_mem; m_rx_dataset_mem = nullptr; }
+    for (auto dataset : m_rx_node_datasets) randomx_release_dataset(dataset);
+    for (auto mem : m_rx_node_dataset_mems) delete mem;
+    m_rx_node_datasets.clear();
+    m_rx_node_dataset_mems.clear();
+    if (m_rx_shared_dataset_mem) { delete m_rx_shared_dataset_mem; m_rx_shared_dataset_mem = nullptr; }
     if (m_rx_cache_mem)   { delete m_rx_cache_mem; m_rx_cache_mem = nullptr; }
   }
 }
 
-void Core::set_fn(cn_any_hash_fun fn) {
-  m_fn.any     = fn;
-  m_timestamp  = 0;
-  m_hash_count = 0;
+void Core::free_thread_pool() {
+  if (m_thread_pool == nullptr) return;
+  m_jobs->exit();
+  delete m_thread_pool; m_thread_pool = nullptr; // waits for its threads to exit
+  delete m_jobs; m_jobs = nullptr;
+}
+
+void Core::free_rx_vms() {
+  for (auto vm : m_vm) randomx_destroy_vm(vm);
+  m_vm.clear();
+}
+
+void Core::free_rx_verify_dataset(RxVerifySeed& rx_seed) {
+  if (rx_seed.dataset)     { randomx_release_dataset(rx_seed.dataset); rx_seed.dataset = nullptr; }
+  if (rx_seed.dataset_mem) { delete rx_seed.dataset_mem; rx_seed.dataset_mem = nullptr; }
+}
+
+void Core::free_rx_verify_vms() {
+  for (auto vm : m_rx_verify_vms) randomx_destroy_vm(vm);
+  m_rx_verify_vms.clear();
+  m_rx_verify_seed_hex.clear();
+}
+
+void Core::free_rx_verify() {
+  free_rx_verify_vms();
+  if (m_verify_pool)     { delete m_verify_pool; m_verify_pool = nullptr; }
+  if (m_rx_verify_lpads) { delete m_rx_verify_lpads; m_rx_verify_lpads = nullptr; }
+  for (auto& rx_seed : m_rx_verify_seeds) {
+    free_rx_verify_dataset(rx_seed);
+    randomx_release_cache(rx_seed.cache);
+    delete rx_seed.cache_mem;
+  }
+  m_rx_verify_seeds.clear();
 }
 
 bool Core::process_message(const std::string& type, const MessageValues& v) {
-  if (type == "test") {
-    set_job(false, false, v);
-    m_nonce  = 0;
-    m_target = 0;
+  if (type == "job") {
+    const uint64_t target = get_target(v);
+    set_job(true, true, v, [=, this]() { m_target = target; });
+
+  } else if (type == "bench") {
+    // bench job over fake zero blob (with ghostrider header size) and seed if they are not given
+    MessageValues v2 = v;
+    if (!v2.contains("blob_hex")) v2["blob_hex"] = std::string(80*2, '0');
+    if (!v2.contains("seed_hex")) v2["seed_hex"] = std::string(HASH_LEN*2, '0');
+    const uint64_t bench_time = v.contains("bench_time") ?
+                                strtoull(v.at("bench_time").c_str(), nullptr, 10) : 10;
+    if (!bench_time) throw std::string("Bad bench_time value");
+    m_bench_start          = xmrig::Chrono::steadyMSecs();
+    m_rx_dataset_init_time = 0;
+    set_job(true, false, v2, [=, this]() {
+      m_target = 0;
+      m_first_hash_timestamp = 0;
+      m_hashrate.reset(m_hashrate.thread_num(), m_bench_start);
+      m_bench_end = xmrig::Chrono::steadyMSecs() + bench_time * 1000;
+    });
+
+  } else if (type == "test") {
+    set_job(false, false, v, [this]() { m_target = 0; });
+
+  } else if (type == "verify") {
+    verify(v);
+
+  } else if (type == "stats") {
+    send_stats();
+
+  } else if (type == "pause") { // stop hashing keeping all job memory
+    if (m_is_paused) return true;
+    m_is_paused = is_hashing();
+    stop_threads();
+
+  } else if (type == "resume") {
+    if (!m_is_paused) return true;
+    m_is_paused = false;
+    start_threads();
 
   } else if (type == "close") {
-    if (m_nonce) send_last_nonce(m_nonce, m_pool_id);
-    free_memory();
+    m_bench_end = 0;
+    free_memory(); // hashing threads also send their last nonces here
+    free_rx_verify();
+    set_msr(false); // restores original MSR values if this core was their last user
     return false; // stop processing messages
   }
 
@@ -185,15 +367,18 @@ void Core::Execute(const AsyncProgressQueueWorker<char>::ExecutionProgress& prog
   if (ci.has(xmrig::ICpuInfo::FLAG_SSE41)) rx_blake2b_compress = rx_blake2b_compress_sse41;
   if (ci.hasAVX2())                        rx_blake2b          = blake2b_avx2;
 
-  randomx_set_scratchpad_prefetch_mode(0);
-  randomx_set_huge_pages_jit(true);
-  randomx_set_optimized_dataset_init(1);
+  // rx settings are process wide defaults until rx jobs tune them (see tune_rx_aes_init, tune_rx)
+  static std::once_flag rx_defaults;
+  std::call_once(rx_defaults, []() {
+    randomx_set_scratchpad_prefetch_mode(0);
+    randomx_set_huge_pages_jit(true);
+    randomx_set_optimized_dataset_init(1);
+  });
   m_progress = &progress;
 
   while (true) {
-    std::deque<Message> messages;
-    fromNode.readAll(messages);
-    for (const auto& message : messages) {
+    Message message;
+    while (fromNode.read(message)) {
       try {
         if (!process_message(message.name, message.values)) return;
       } catch(const std::string& err) {
@@ -201,81 +386,38 @@ void Core::Execute(const AsyncProgressQueueWorker<char>::ExecutionProgress& prog
       }
     }
 
+    // report rx dataset file saving error as soon as it is known
+    if (m_rx_save.valid() && m_rx_save.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+      wait_rx_save();
 
-    // we skip first hash function run using m_hash_count check to exclude GPU compile time
-    // that effectively skips it in test mode too
-    static unsigned hashrate_check_counter = HASHRATE_COUNTER_INTERVAL;
-    if (m_dev == DEV::RX_CPU) m_mutex_hashrate.lock();
-    const unsigned hash_count = m_hash_count;
-    if (m_dev == DEV::RX_CPU) m_mutex_hashrate.unlock();
-    if (hash_count && --hashrate_check_counter == 0) {
-      hashrate_check_counter = HASHRATE_COUNTER_INTERVAL;
-      const uint64_t new_timestamp = std::chrono::time_point_cast<std::chrono::milliseconds>(
-        std::chrono::high_resolution_clock::now()
-      ).time_since_epoch().count();
-      if (!m_timestamp || new_timestamp - m_timestamp > 60*1000) {
-        if (m_timestamp) send_msg("hashrate", "hashrate", std::to_string(
-          static_cast<float>(hash_count) / (new_timestamp - m_timestamp) * 1000.0f
-        ));
-        m_timestamp = new_timestamp;
-        if (m_dev == DEV::RX_CPU) m_mutex_hashrate.lock();
-        m_hash_count = 0;
-        if (m_dev == DEV::RX_CPU) m_mutex_hashrate.unlock();
-      }
-    }
-
-    if (m_fn.any) {
+    // switch to the job waiting for its rx dataset as soon as it is ready
+    if (m_next_job && (!m_rx_prep.valid() ||
+        m_rx_prep.wait_for(std::chrono::seconds(0)) == std::future_status::ready)) {
+      const std::function<void(void)> next_job = std::move(m_next_job);
+      m_next_job = nullptr;
+      stop_threads(); // so set_job does not prepare the dataset in background again
       try {
-        switch (m_dev) {
-          case DEV::CPU:
-            m_fn.cpu(m_input_cn, m_input_cn_len, m_output, m_ctx, m_height);
-            break;
-
-          case DEV::RX_CPU: throw "Internal error: Unreachable code executed";
-        }
+        next_job();
       } catch(const std::string& err) {
-        send_error(std::string("Compute function exception: ") + err);
-        set_fn(nullptr);
-        continue;
-      } catch(...) {
-        send_error("Compute function exception");
-        set_fn(nullptr);
-        continue;
-      }
-
-      if (!m_nonce) { // test job
-        std::string result_hash_str;
-        for (unsigned i = 0; i != m_batch; ++ i) {
-          if (i) result_hash_str += " ";
-          char hash[HASH_LEN*2+1];
-          result_hash_str += hash_bin2hex(hash, i);
-        }
-        send_msg("test", "result", result_hash_str);
-        set_fn(nullptr);
-        continue;
-      }
-
-      m_hash_count += m_batch; // here we do not need mutex since there are no threads
-
-      const uint32_t prev_nonce = m_nonce;
-      for (unsigned i = 0; i != m_batch; ++i) {
-        uint32_t* const pnonce = get_nonce_cn(i);
-        if (m_target && *get_result(i) < m_target) send_result(*pnonce, m_output + HASH_LEN * i);
-        *pnonce = m_nonce;
-        m_nonce += m_nonce_step;
+        send_error(std::string("Message processing exception: ") + err);
       }
+    }
 
-      if (m_target && ( m_is_nicehash ? (prev_nonce & 0xFF000000) != (m_nonce & 0xFF000000) :
-                        prev_nonce > m_nonce )
-      ) {
-        send_error("Nonce overflow");
-        set_fn(nullptr);
-        continue;
-      }
+    const uint64_t timestamp = xmrig::Chrono::steadyMSecs();
+    if (m_bench_end && timestamp >= m_bench_end) send_bench_result();
 
-    } else {
-      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    m_hashrate.sample(timestamp);
+    // bench mode reports its own hashrate
+    if (!m_bench_end && timestamp - m_timestamp >= HASHRATE_REPORT_INTERVAL) {
+      m_timestamp = timestamp;
+      const float hashrate = m_hashrate.get(HASHRATE_REPORT_INTERVAL);
+      if (hashrate > 0.0f) send_msg("hashrate", "hashrate", std::to_string(hashrate));
     }
+
+    // hashing is done in m_thread_pool so sleep till next message (or next hashrate/bench check or
+    // rx dataset preparation/saving check that is needed even if the old job stopped hashing)
+    const bool is_rx_pending = m_next_job || m_rx_prep.valid() || m_rx_save.valid();
+    fromNode.wait(m_bench_end || is_hashing() || is_rx_pending ? IDLE_WAIT_TIME : -1);
   }
 }
 
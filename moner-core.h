@@ -3,7 +3,14 @@
 #pragma once
 
 #include "async-worker.h"
-#include "ctpl-stl.h" // used for randomx threads
+#include "hashrate.h"
+#include "idle-threads.h"
+#include "job-slot.h"
+#include "nonce-counter.h"
+#include "shared-memory.h"
+#include <list>
+#include <mutex>
+#include "ctpl-stl.h" // used for hashing threads
 #include "crypto/common/VirtualMemory.h"
 #include "crypto/cn/CnHash.h"
 #include "crypto/randomx/randomx.h"
@@ -26,65 +33,163 @@ union FN {
 };
 enum DEV { CPU, RX_CPU, GPU };
 
+// job of hashing threads (it is not changed after it is published to them)
+struct HashJob {
+  DEV dev;
+  FN fn;
+  std::vector<std::string> input_hexes;
+  std::vector<std::vector<uint8_t> > inputs;
+  std::vector<unsigned> cpus; // CPUs threads are pinned to
+  std::shared_ptr<NonceCounter> nonces; // shared by jobs of the same pool job (also after resume)
+  uint64_t target;
+  unsigned threads, batch, height, nonce_offset;
+  uint32_t job_slot;
+  bool is_nicehash, is_set_nonce;
+  std::string pool_id, job_id;
+
+  inline uint32_t* get_nonce(uint8_t* const input) const {
+    return reinterpret_cast<uint32_t*>(input + nonce_offset);
+  }
+};
+
 class Core: public AsyncWorker {
-  const unsigned HASHRATE_COUNTER_INTERVAL = 10; // iterations to skip to update/check hashrate
+  const unsigned HASHRATE_REPORT_INTERVAL  = 60*1000; // ms between hashrate messages
+  const int      IDLE_WAIT_TIME            = 100; // max ms to wait for message if threads are hashing
+  const unsigned DATASET_PROGRESS_INTERVAL = 1000; // ms between dataset_progress messages
+  const unsigned RX_VERIFY_CACHE_NUM       = 4; // rx caches of most recently used verify seeds
   // store pointer to send messages back easier
   const AsyncProgressQueueWorker<char>::ExecutionProgress* m_progress;
   FN m_fn;
   DEV m_dev;
   xmrig::VirtualMemory *m_lpads, *m_rx_cache_mem, *m_rx_dataset_mem;
-  void* m_spads;
-  struct cryptonight_ctx** m_ctx;
-  uint8_t *m_input_cn, *m_output;
-  unsigned m_job_ref, m_height, m_batch, m_mem_size, m_input_cn_len, m_nonce_step, m_nonce_offset;
-  uint32_t m_nonce; // next nonce that will be used in an input
-  uint64_t m_target, m_timestamp, m_hash_count;
-  std::string m_algo_str, m_dev_str, m_seed_hex, m_input_hex, m_pool_id, m_worker_id, m_job_id;
-  bool m_is_rx_jit, m_is_nicehash;
+  struct cryptonight_ctx** m_ctx; // m_batch contexts for each cn thread
+  unsigned m_height, m_batch, m_threads, m_mem_size, m_nonce_offset;
+  std::vector<unsigned> m_cpus; // logical CPUs hashing threads are pinned to (see CpuTopology)
+  uint64_t m_target, m_timestamp; // m_timestamp is time of the last hashrate message (ms)
+  Hashrate m_hashrate;
+  uint64_t m_bench_start, m_bench_end, m_rx_dataset_init_time; // bench mode timestamps (ms)
+  std::atomic<uint64_t> m_first_hash_timestamp; // set by the first computed hash of the job
+  std::string m_algo_str, m_dev_str, m_seed_hex, m_input_hex, m_pool_id, m_job_id;
+  std::string m_rx_dataset_dir; // directory of rx dataset files (they are not used if it is empty)
+  uint32_t m_job_slot; // job id for binary results
+  bool m_is_one_gb_dataset, m_is_one_gb_lpads; // 1 GB pages are requested for them
+  bool m_is_msr; // rx MSR preset is applied by this core (see MsrPresets)
+  bool m_is_rx_jit, m_is_rx_tuned, m_is_rx_shared, m_is_rx_light, m_is_rx_numa, m_is_nicehash, m_is_set_nonce, m_is_paused;
+  std::vector<std::string> m_input_hexes;
+  std::vector<std::vector<uint8_t> > m_inputs;
+  std::shared_ptr<NonceCounter> m_nonces; // nonces of the current job (see NonceCounter)
   randomx_cache*   m_rx_cache;
   randomx_dataset* m_rx_dataset;
-  ctpl::thread_pool* m_thread_pool;
-  randomx_vm** m_vm;
-  std::mutex m_mutex_hashrate;
+  SharedMemory*    m_rx_shared_dataset_mem; // used instead of m_rx_dataset_mem in shared mode
+  // m_rx_dataset copies for NUMA nodes 1, 2... (m_rx_dataset is on node 0)
+  std::vector<xmrig::VirtualMemory*> m_rx_node_dataset_mems;
+  std::vector<randomx_dataset*>      m_rx_node_datasets;
+  // rx cache and dataset of a new (or next) seed prepared in background while threads hash
+  xmrig::VirtualMemory *m_rx_next_cache_mem, *m_rx_next_dataset_mem;
+  randomx_cache*   m_rx_next_cache;
+  randomx_dataset* m_rx_next_dataset;
+  std::string      m_rx_next_seed_hex;
+  uint64_t         m_rx_next_init_time;
+  bool             m_is_rx_next_built; // computed and not loaded from dataset file
+  IdleThreads      m_rx_prep_threads; // background preparation threads
+  std::future<std::string> m_rx_prep; // returns error string of the background preparation
+  std::function<void(void)> m_next_job; // sets job waiting for m_rx_prep
+  std::future<std::string> m_rx_save; // returns error string of the background dataset file saving
+  ctpl::thread_pool* m_thread_pool; // persistent hashing threads (see hash_thread)
+  JobSlot<HashJob>*  m_jobs;        // jobs of m_thread_pool threads
+  ctpl::thread_pool* m_rx_init_pool; // dataset init threads pinned to all CPUs (kept between seeds)
+  std::vector<randomx_vm*> m_vm; // one for each rx thread
+  // rx cache (and dataset in full mode) of one seed for verify messages
+  struct RxVerifySeed {
+    std::string algo_str, seed_hex;
+    xmrig::VirtualMemory *cache_mem, *dataset_mem;
+    randomx_cache*   cache;
+    randomx_dataset* dataset;
+  };
+  std::list<RxVerifySeed> m_rx_verify_seeds; // most recently used first
+  std::vector<randomx_vm*> m_rx_verify_vms; // one for each m_verify_pool thread
+  xmrig::VirtualMemory* m_rx_verify_lpads; // scratchpads of m_rx_verify_vms
+  std::string m_rx_verify_algo_str, m_rx_verify_seed_hex; // of m_rx_verify_vms
+  bool m_is_rx_verify_jit, m_is_rx_verify_full;
+  ctpl::thread_pool* m_verify_pool;
 
-  inline uint32_t* get_nonce(uint8_t* const input) {
-    return reinterpret_cast<uint32_t*>(input + m_nonce_offset);
-  }
-  inline uint32_t* get_nonce_cn(const unsigned batch) {
-    return reinterpret_cast<uint32_t*>(m_input_cn + (batch * m_input_cn_len) + m_nonce_offset);
+  inline randomx_dataset* get_rx_node_dataset(const unsigned node) {
+    return node && node <= m_rx_node_datasets.size() ? m_rx_node_datasets[node - 1] : m_rx_dataset;
   }
+
   inline const uint64_t* get_result(const uint8_t* const output, const unsigned batch = 0) const {
     return reinterpret_cast<const uint64_t*>(output + (batch * HASH_LEN) + 24);
   }
-  inline const uint64_t* get_result(const unsigned batch) const {
-    return get_result(m_output, batch);
-  }
 
   char* hash_bin2hex(const uint8_t* const output, char* hash, const unsigned batch = 0) const;
-  char* hash_bin2hex(char* const hash, const unsigned batch) const;
   void send_msg(const std::string key, const MessageValues& values);
   void send_msg(
     const std::string& topic, const std::string& key = std::string(),
     const std::string& value = std::string()
   );
   void send_error(const std::string& str);
-  void send_result(const uint32_t nonce, const uint8_t* const output);
+  void send_result(
+    const uint32_t nonce, const uint8_t* const output, const uint32_t job_slot,
+    const unsigned thread_id
+  );
   void send_last_nonce(const uint32_t nonce, const std::string& pool_id);
+  void send_nonce_exhausted(const HashJob& job);
+  std::string get_cpus_str() const;
+  void send_bench_result();
+  void send_stats();
+  void set_first_hash_timestamp();
+  void prepare_rx_dataset(
+    const std::string& seed_hex, const uint8_t* const seed, const bool is_idle = false
+  );
+  void wait_rx_prep();
+  void free_rx_next(const bool is_keep_memory = false);
+  uint64_t init_rx_dataset(
+    randomx_dataset* const dataset, randomx_cache* const cache, const uint8_t* const seed,
+    IdleThreads* const idle_threads = nullptr
+  );
+  uint64_t init_rx_dataset(
+    randomx_dataset* const dataset, randomx_cache* const cache, const uint8_t* const seed,
+    const std::string& path, bool& is_built, IdleThreads* const idle_threads = nullptr
+  );
+  void save_rx_dataset(const std::string& path);
+  void replicate_rx_dataset(const bool is_one_gb_pages);
+  void set_rx_vm_datasets();
+  void wait_rx_save();
+  void free_rx_vms();
+  void tune_rx_aes_init(const uint8_t* const seed);
+  void tune_rx(const uint8_t* const seed);
+  RxVerifySeed& get_rx_verify_seed(
+    const std::string& algo_str, const std::string& seed_hex, const uint8_t* const seed,
+    const bool is_full
+  );
+  void free_rx_verify_dataset(RxVerifySeed& rx_seed);
+  void free_rx_verify_vms();
+  void free_rx_verify();
+  void verify(const MessageValues& v);
+  void set_msr(const bool is_msr);
   void free_memory(
     const bool is_batch_changed    = true,
     const bool is_mem_size_changed = true,
     const bool is_free_cn          = true,
     const bool is_free_rx          = true
   );
-  void set_fn(cn_any_hash_fun fn);
   void set_job(
     const bool is_set_nonce, const bool is_no_same_input, const MessageValues& v,
     std::function<void(void)> fn_extra_setup = [](){}
   );
+  void free_thread_pool();
+  void start_threads();
+  void hash_thread(const unsigned thread_id);
+  void hash_rx(HashJob& job, const unsigned thread_id, const uint64_t seq);
+  void hash_cn(HashJob& job, const unsigned thread_id, const uint64_t seq);
+  void stop_threads();
+  bool is_hashing();
   void get_algo_params(const MessageValues& v);
   bool process_message(const std::string& type, const MessageValues& v);
 
   static bool hex2bin(const char* in, unsigned int len, unsigned char* out);
+  static uint64_t get_target(const MessageValues& v);
+  static size_t get_page_size(const xmrig::VirtualMemory* const mem);
   static std::vector<std::string> tokenize(const std::string& str, const char delim);
 
   public:
@@ -92,14 +197,21 @@ class Core: public AsyncWorker {
   Core(
     Nan::Callback* const data, Nan::Callback* const complete,
     Nan::Callback* const error_callback,  const v8::Local<v8::Object>& options
-  ) : AsyncWorker(data, complete, error_callback), m_progress(nullptr),
+  ) : AsyncWorker(data, complete, error_callback), m_progress(nullptr), m_dev(DEV::CPU),
       m_lpads(nullptr), m_rx_cache_mem(nullptr), m_rx_dataset_mem(nullptr),
-      m_spads(nullptr), m_ctx(nullptr), m_input_cn(nullptr), m_output(nullptr),
-      m_job_ref(0), m_height(0), m_batch(0), m_mem_size(0), m_input_cn_len(0),
-      m_nonce_step(1), m_nonce_offset(39), m_nonce(0), m_target(0),
-      m_timestamp(0), m_hash_count(0),
-      m_is_rx_jit(true), m_is_nicehash(true), m_rx_cache(nullptr), m_rx_dataset(nullptr),
-      m_thread_pool(nullptr), m_vm(nullptr)
+      m_ctx(nullptr), m_height(0), m_batch(0), m_threads(0), m_mem_size(0),
+      m_nonce_offset(39), m_target(0),
+      m_timestamp(0), m_bench_start(0), m_bench_end(0),
+      m_rx_dataset_init_time(0), m_first_hash_timestamp(0), m_job_slot(0),
+      m_is_one_gb_dataset(false), m_is_one_gb_lpads(false), m_is_msr(false),
+      m_is_rx_jit(true), m_is_rx_tuned(false), m_is_rx_shared(false), m_is_rx_light(false), m_is_rx_numa(false), m_is_nicehash(true), m_is_set_nonce(false), m_is_paused(false),
+      m_rx_cache(nullptr), m_rx_dataset(nullptr), m_rx_shared_dataset_mem(nullptr),
+      m_rx_next_cache_mem(nullptr), m_rx_next_dataset_mem(nullptr),
+      m_rx_next_cache(nullptr), m_rx_next_dataset(nullptr), m_rx_next_init_time(0),
+      m_is_rx_next_built(false),
+      m_thread_pool(nullptr), m_jobs(nullptr), m_rx_init_pool(nullptr),
+      m_rx_verify_lpads(nullptr), m_is_rx_verify_jit(true), m_is_rx_verify_full(false),
+      m_verify_pool(nullptr)
   {
     m_fn.any = nullptr;
   }
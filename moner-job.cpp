@@ -1,24 +1,73 @@
 // Copyright GNU GPLv3 (c) 2023-2025 MoneroOcean <support@moneroocean.stream>
 
 #include "moner-core.h"
+#include "cpu-topology.h"
+#include "dataset-file.h"
+#include "numa-nodes.h"
 
 #include "backend/cpu/Cpu.h"
+#include "base/tools/Chrono.h"
 #include "crypto/cn/CnCtx.h"
 #include "crypto/cn/CryptoNight.h"
 #include "crypto/ghostrider/ghostrider.h"
 #include "crypto/randomx/configuration.h"
 #include "crypto/randomx/aes_hash.hpp"
+#include "crypto/randomx/blake2_generator.hpp"
+#include "crypto/randomx/dataset.hpp"
+#include "crypto/randomx/jit_compiler.hpp"
+#include "crypto/randomx/superscalar.hpp"
+#include "crypto/randomx/virtual_machine.hpp"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <climits>
+#include <filesystem>
+#include <fstream>
 #include <ranges>
 #include <list>
+#include <mutex>
 #include <set>
 #include <thread>
 #include <sstream>
 
+#if defined(__linux__)
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
 const unsigned MAX_CN_CPU_WAYS = 5;
+const unsigned MAX_CPU_BATCH   = 8; // ghostrider batch
 const unsigned MAX_BLOB_LEN    = 512;
+const unsigned RX_DATASET_FILE_CHECK_NUM = 64; // dataset items recomputed to check loaded dataset
+const unsigned RX_DATASET_INIT_ALIGN     = 45; // AVX2 (5 items) and AVX-512 (9 items) init alignment
+const unsigned RX_DATASET_INIT_CHUNK     = RX_DATASET_INIT_ALIGN*128; // dataset items taken by init thread at once
+const unsigned RX_TUNE_HASHES     = 32; // hashes timed for each scratchpad prefetch mode
+const unsigned RX_TUNE_INIT_ITEMS = 2*RX_DATASET_INIT_CHUNK; // dataset items timed for each init variant
+const unsigned RX_TUNE_AES_SPADS  = 32; // scratchpads hashed and filled for each hard AES variant
+const unsigned RX_TUNE_ROUNDS     = 3;  // the best time of these rounds is used
+const std::string RX_TUNE_FILE_NAME = "fast-rx-tune.txt"; // in dataset_dir (or temp dir)
 
 static const xmrig::ICpuInfo& ci = *xmrig::Cpu::info();
+static const NumaNodes numa_nodes;
+static const CpuTopology cpu_topology;
+
+// rx tuning results by CPU model (-1 if not timed yet), they are process wide like rx settings
+// they select
+struct RxTune {
+  int prefetch_mode; // for randomx_set_scratchpad_prefetch_mode
+  int dataset_init;  // for randomx_set_optimized_dataset_init
+  int aes_impl;      // for SelectHardAESImpl
+};
+static std::mutex rx_tune_mutex;
+static std::map<std::string, RxTune> rx_tunes;
+static MessageValues rx_tune_rates; // timed by this process for rx_tune message
+// hard AES impl and dataset init variant are only selected before the first rx cache of the
+// process is created, since rx hashing and dataset init of all cores use them without locks
+static bool is_rx_aes_init_selected = false;
 
 static const std::map<std::string, xmrig::Algorithm::Id> cpu_name2algo = {
   { "cn/0",            xmrig::Algorithm::CN_0           },
@@ -76,16 +125,21 @@ static const std::map<std::string, unsigned> algo2mem = [](){
   return result;
 }();
 
-static xmrig::VirtualMemory* alloc_huge_mem(const unsigned size) {
-  xmrig::VirtualMemory* const mem = new xmrig::VirtualMemory(size, true, false, false);
+// huge pages (or 1 GB pages if they are requested and available) with fallback to normal pages
+static xmrig::VirtualMemory* alloc_huge_mem(const size_t size, const bool is_one_gb_pages = false) {
+  xmrig::VirtualMemory* const mem = new xmrig::VirtualMemory(size, true, is_one_gb_pages, false);
   if (mem->raw()) return mem;
   throw std::string("Can't allocate " + std::to_string(size) + " bytes of memory");
 }
 
-static void* alloc_mem(const unsigned size) {
-  void* const mem = _mm_malloc(size, 4096);
-  if (mem) return mem;
-  throw std::string("Can't allocate " + std::to_string(size) + " bytes of memory");
+// pins the calling thread to one logical CPU of this host (no-op on non Linux platforms)
+static void pin_thread(const unsigned cpu) {
+#if defined(__linux__)
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+#endif
 }
 
 void ghostrider(
@@ -99,18 +153,100 @@ static void init_rx_dataset_thread(
   randomx_dataset* const dataset, randomx_cache* const cache,
   const unsigned start, const unsigned count
 ) {
-  if (ci.hasAVX2() && (count % 5)) {
-    randomx_init_dataset(dataset, cache, start, count - (count % 5));
-    randomx_init_dataset(dataset, cache, start + count - 5, 5);
-  } else randomx_init_dataset(dataset, cache, start, count);
+  // vector init code computes items in groups so the tail is recomputed from an aligned count of
+  // items before the end
+  const unsigned tail = count % RX_DATASET_INIT_ALIGN;
+  if (count > tail) randomx_init_dataset(dataset, cache, start, count - tail);
+  if (tail) randomx_init_dataset(dataset, cache, start + count - RX_DATASET_INIT_ALIGN, RX_DATASET_INIT_ALIGN);
+}
+
+// rx dataset file name includes all rx config parameters that change its cache or dataset
+static std::string get_rx_dataset_file_path(
+  const std::string& dir, const std::string& algo_str, const std::string& seed_hex
+) {
+  if (dir.empty()) return std::string();
+  const RandomX_ConfigurationBase& c = RandomX_CurrentConfig;
+  std::ostringstream params;
+  params << c.ArgonMemory << ' ' << c.ArgonIterations << ' ' << c.ArgonLanes << ' ' << c.ArgonSalt
+         << ' ' << c.CacheAccesses << ' ' << c.SuperscalarLatency << ' ' << c.DatasetBaseSize
+         << ' ' << c.DatasetExtraSize;
+  uint64_t params_hash = 0xCBF29CE484222325ULL; // FNV-1a
+  for (const char ch : params.str()) params_hash = (params_hash ^ static_cast<uint8_t>(ch)) * 0x100000001B3ULL;
+  std::string algo = algo_str;
+  std::replace(algo.begin(), algo.end(), '/', '_');
+  char params_hex[17];
+  snprintf(params_hex, sizeof(params_hex), "%016llx", static_cast<unsigned long long>(params_hash));
+  return dir + "/fast-rx-" + algo + "-" + seed_hex + "-" + params_hex + ".dataset";
+}
+
+static std::vector<DatasetFile::Block> get_rx_dataset_blocks(
+  randomx_dataset* const dataset, randomx_cache* const cache
+) {
+  return {
+    { cache->memory, RandomX_CurrentConfig.ArgonMemory * randomx::ArgonBlockSize },
+    { static_cast<uint8_t*>(randomx_get_dataset_memory(dataset)),
+      randomx_dataset_item_count() * static_cast<size_t>(RANDOMX_DATASET_ITEM_SIZE) }
+  };
+}
+
+// generates superscalar programs (and their JIT code) of the cache which memory is already inited
+// for the seed (what randomx_init_cache does after argon2 fill)
+static void compile_rx_cache(randomx_cache* const cache, const uint8_t* const seed) {
+  cache->rxConfig = RandomX_CurrentConfigPtr; // as randomx_init_cache does
+  randomx::Blake2Generator gen(seed, HASH_LEN);
+  for (uint32_t i = 0; i < RandomX_CurrentConfig.CacheAccesses; ++i)
+    randomx::generateSuperscalar(cache->programs[i], gen);
+  if (cache->jit) {
+#   ifdef XMRIG_SECURE_JIT
+    cache->jit->enableWriting();
+#   endif
+    cache->jit->generateSuperscalarHash(cache->programs);
+    cache->jit->generateDatasetInitCode();
+    cache->datasetInit = cache->jit->getDatasetInitFunc();
+#   ifdef XMRIG_SECURE_JIT
+    cache->jit->enableExecution();
+#   endif
+  }
+}
+
+// loads rx cache and dataset for the seed from the file and checks some dataset items
+// (superscalar programs of the cache are not stored since they are fast to generate)
+static bool load_rx_dataset(
+  randomx_dataset* const dataset, randomx_cache* const cache, const uint8_t* const seed,
+  const std::string& path
+) {
+  if (path.empty() || !DatasetFile::load(path, get_rx_dataset_blocks(dataset, cache))) return false;
+  compile_rx_cache(cache, seed);
+  const uint8_t* const items = static_cast<const uint8_t*>(randomx_get_dataset_memory(dataset));
+  const uint64_t item_count = randomx_dataset_item_count();
+  for (unsigned i = 0; i != RX_DATASET_FILE_CHECK_NUM; ++i) {
+    const uint64_t item = (item_count - 1) * i / (RX_DATASET_FILE_CHECK_NUM - 1);
+    uint8_t out[RANDOMX_DATASET_ITEM_SIZE];
+    randomx::initDatasetItem(cache, out, item);
+    if (memcmp(out, items + item * RANDOMX_DATASET_ITEM_SIZE, RANDOMX_DATASET_ITEM_SIZE)) return false;
+  }
+  return true;
+}
+
+static randomx_cache* create_rx_cache(const xmrig::VirtualMemory* const mem, bool& is_rx_jit) {
+  {
+    std::lock_guard<std::mutex> lock(rx_tune_mutex);
+    is_rx_aes_init_selected = true;
+  }
+  randomx_cache* cache = nullptr;
+  if (is_rx_jit) cache = randomx_create_cache(RANDOMX_FLAG_JIT, mem->raw());
+  if (cache == nullptr) {
+    is_rx_jit = false;
+    cache = randomx_create_cache(RANDOMX_FLAG_DEFAULT, mem->raw());
+  }
+  return cache;
 }
 
 static randomx_flags get_rx_vm_flags(
-  const bool is_rx_jit, const randomx_dataset* const m_rx_dataset,
-  const xmrig::VirtualMemory* const m_rx_dataset_mem
+  const bool is_rx_jit, const randomx_dataset* const m_rx_dataset, const bool is_huge_pages
 ) {
   unsigned rx_flags = RANDOMX_FLAG_DEFAULT;
-  if (m_rx_dataset_mem->isHugePages()) rx_flags |= RANDOMX_FLAG_LARGE_PAGES;
+  if (is_huge_pages) rx_flags |= RANDOMX_FLAG_LARGE_PAGES;
   if (ci.hasAES()) rx_flags |= RANDOMX_FLAG_HARD_AES;
   if (m_rx_dataset) rx_flags |= RANDOMX_FLAG_FULL_MEM;
   if (is_rx_jit) rx_flags |= RANDOMX_FLAG_JIT;
@@ -140,28 +276,60 @@ void Core::set_job(
                     new_algo_str   = v.at("algo"),
                     new_input_hex  = v.at("blob_hex"),
                     new_seed_hex   = v.contains("seed_hex") ? v.at("seed_hex") : std::string(),
-                    job_id         = v.contains("job_id")   ? v.at("job_id")   : std::string();
+                    next_seed_hex  = v.contains("next_seed_hex") ? v.at("next_seed_hex") : std::string(),
+                    new_rx_dataset_dir = v.contains("dataset_dir") ? v.at("dataset_dir") : std::string(),
+                    job_id         = v.contains("job_id")   ? v.at("job_id")   : std::string(),
+                    pool_id        = v.contains("pool_id")  ? v.at("pool_id")  : std::string();
   const unsigned    new_height     = v.contains("height") ? atoi(v.at("height").c_str()) : 0,
                     new_thread_id  = v.contains("thread_id") ?
                                      atoi(v.at("thread_id").c_str()) : 0,
                     new_thread_num = v.contains("thread_num") ?
-                                     atoi(v.at("thread_num").c_str()) : 1;
-  const uint32_t    new_nonce      = v.contains("nonce") ? atoi(v.at("nonce").c_str()) : 0;
+                                     atoi(v.at("thread_num").c_str()) : 1,
+                    new_cn_threads = v.contains("threads") ? atoi(v.at("threads").c_str()) : 1;
+  const uint32_t    new_nonce      = v.contains("nonce") ? atoi(v.at("nonce").c_str()) : 0,
+                    new_job_slot   = v.contains("job_slot") ? atoi(v.at("job_slot").c_str()) : 0;
   const bool        new_nicehash   = v.contains("is_nicehash") ?
-                                     atoi(v.at("is_nicehash").c_str()) : 0;
+                                     atoi(v.at("is_nicehash").c_str()) : 0,
+                    new_is_rx_shared = v.contains("shared_dataset") ?
+                                     atoi(v.at("shared_dataset").c_str()) : 0,
+                    new_is_numa    = v.contains("numa") ? atoi(v.at("numa").c_str()) : 1,
+                    is_rx_tune     = v.contains("rx_tune") ? atoi(v.at("rx_tune").c_str()) : 1,
+                    is_msr         = v.contains("msr") ? atoi(v.at("msr").c_str()) : 0;
+  // 1 GB pages are used for rx dataset (1) and also for scratchpads (2)
+  const unsigned    new_one_gb_pages = v.contains("one_gb_pages") ? atoi(v.at("one_gb_pages").c_str()) : 0;
+  const bool        new_is_one_gb_dataset = new_one_gb_pages >= 1,
+                    new_is_one_gb_lpads   = new_one_gb_pages >= 2;
 
   if (is_no_same_input && new_input_hex == m_input_hex) throw std::string("Ignore duplicate job");
+  if (new_thread_num == 0 || new_thread_id >= new_thread_num) throw std::string("Bad thread_id");
   auto batch_parts = tokenize(new_dev_str, '*');
   if (batch_parts.size() == 0 || batch_parts.size() > 2)
     throw std::string("Invalid dev specification");
   const std::string new_dev_str2 = batch_parts[0];
   const unsigned new_batch = batch_parts.size() == 2 ? atoi(batch_parts[1].c_str()) : 1;
+  // optional explicit CPUs of hashing threads are after @ (like "cpu*4@0-1:8-9")
+  const size_t cpu_list_pos = batch_parts.size() == 2 ? batch_parts[1].find('@') : std::string::npos;
+  const std::string new_cpu_list = cpu_list_pos == std::string::npos ? std::string() :
+                                   batch_parts[1].substr(cpu_list_pos + 1);
+  if (cpu_list_pos != std::string::npos && new_cpu_list.empty())
+    throw std::string("Invalid dev specification");
   const DEV new_dev = new_algo_str.starts_with("rx/") ? DEV::RX_CPU : DEV::CPU;
+  // light rx VMs compute dataset items from the cache on the fly (no dataset is allocated)
+  const bool new_is_rx_light = new_dev_str2 == "cpu-light";
+  if (new_is_rx_light && new_dev != DEV::RX_CPU) throw std::string("Light mode is only supported for RX algos");
+  // each NUMA node gets its own private dataset copy
+  const bool new_is_rx_numa = new_dev == DEV::RX_CPU && new_is_numa && numa_nodes.size() > 1 &&
+                              !new_is_rx_shared && !new_is_rx_light;
+  // each rx batch item is hashed by its own thread while cn threads hash the whole batch
+  const unsigned new_threads = new_dev == DEV::RX_CPU ? new_batch : new_cn_threads;
+  if (new_threads == 0 || new_threads > RESULT_QUEUE_NUM) throw std::string("Bad threads number");
+  const std::vector<unsigned> new_cpus =
+    cpu_topology.get_cpus(new_cpu_list, new_thread_id * new_threads, new_threads);
 
   FN new_fn;
   unsigned new_nonce_offset;
-  uint8_t new_seed[HASH_LEN];
-  const RandomX_ConfigurationBase* new_rx_config;
+  uint8_t new_seed[HASH_LEN], next_seed[HASH_LEN];
+  const RandomX_ConfigurationBase* new_rx_config = nullptr;
   switch (new_dev) {
     case DEV::CPU: {
       const auto pi = cpu_name2algo.find(new_algo_str);
@@ -187,18 +355,19 @@ void Core::set_job(
       if (new_seed_hex.empty()) throw std::string("No seed_hex job key");
       if (new_seed_hex.size() != HASH_LEN * 2) throw std::string("Bad seed length");
       if (!hex2bin(new_seed_hex.c_str(), HASH_LEN, new_seed)) throw std::string("Bad seed hex");
+      if (!next_seed_hex.empty() && (next_seed_hex.size() != HASH_LEN * 2 ||
+          !hex2bin(next_seed_hex.c_str(), HASH_LEN, next_seed))) throw std::string("Bad next seed hex");
       const auto pi = rx_cpu_name2config.find(new_algo_str);
       if (pi == rx_cpu_name2config.end()) throw std::string("Unsupported algo");
+      if (new_batch == 0 || new_batch > RESULT_QUEUE_NUM) throw std::string("Bad RX batch");
       new_rx_config = pi->second;
-      new_fn.any = nullptr; // all work is done in the m_thread_pool
+      new_fn.any = nullptr; // rx threads use m_vm instead
       new_nonce_offset = 39;
       break;
     }
   }
 
-  // need static here so it will be alive in rx threads
-  static std::vector<std::string> new_input_hexes;
-  new_input_hexes = split_input(new_input_hex);
+  std::vector<std::string> new_input_hexes = split_input(new_input_hex);
   if (new_dev == DEV::RX_CPU) {
     // duplicate one input accross all thread inputs (batches)
     if (new_input_hexes.size() == 1 && new_batch > 1) new_input_hexes.assign(new_batch, new_input_hex);
@@ -207,9 +376,7 @@ void Core::set_job(
     if (new_input_hexes.size() != 1) throw std::string("Multiple inputs are only supported for RX algos");
   }
 
-  // need static here so it will be alive in rx threads
-  static std::vector<std::vector<uint8_t> > new_inputs;
-  new_inputs.clear();
+  std::vector<std::vector<uint8_t> > new_inputs;
   for (const auto& new_input_hex: new_input_hexes) {
     const unsigned new_input_len = new_input_hex.size() >> 1;
     if ((new_input_hex.size() & 1) || new_input_len > MAX_BLOB_LEN)
@@ -219,158 +386,881 @@ void Core::set_job(
       throw std::string("Bad input hex");
   }
 
+  m_rx_dataset_dir = new_rx_dataset_dir; // used by background dataset preparation too
+
+  // new seed rx dataset is prepared in background while threads continue to hash the old job
+  // (shared dataset is prepared by the process that maps it first and light mode has no dataset)
+  if (new_dev == DEV::RX_CPU && m_dev == DEV::RX_CPU && new_algo_str == m_algo_str &&
+      new_seed_hex != m_seed_hex && !new_is_rx_shared && !m_is_rx_shared &&
+      !new_is_rx_light && !m_is_rx_light && is_hashing()
+  ) {
+    if (m_rx_next_seed_hex != new_seed_hex) {
+      wait_rx_prep();
+      prepare_rx_dataset(new_seed_hex, new_seed);
+    } else m_rx_prep_threads.set_idle(false); // next seed dataset is needed now
+    // newer job replaces the one that already waits for the dataset
+    m_next_job = [=, this]() { set_job(is_set_nonce, is_no_same_input, v, fn_extra_setup); };
+    return;
+  }
+  // this job replaces the one that waits for its dataset
+  m_next_job = nullptr;
+  if (m_rx_next_seed_hex == new_seed_hex && m_algo_str == new_algo_str) wait_rx_prep(); // to swap it
+  else if (m_rx_next_seed_hex != next_seed_hex || next_seed_hex.empty() || m_algo_str != new_algo_str) {
+    wait_rx_prep();
+    // memory of the second dataset is kept only if it is going to be used for the next seed
+    free_rx_next(
+      !next_seed_hex.empty() && m_algo_str == new_algo_str && !new_is_rx_shared && !new_is_rx_light
+    );
+  }
+
   // new hashing setup (all errors were checked above)
-  ++ m_job_ref; // used to stop old m_thread_pool jobs
   const unsigned new_mem_size = algo2mem.at(new_algo_str);
-  if (m_batch != new_batch || m_mem_size != new_mem_size ||
-      m_seed_hex != new_seed_hex || m_algo_str != new_algo_str) {
+  const bool is_rx_mode_changed = !m_seed_hex.empty() && !new_seed_hex.empty() &&
+                                  (m_is_rx_shared != new_is_rx_shared || m_is_rx_light != new_is_rx_light ||
+                                   m_is_rx_numa != new_is_rx_numa || m_is_one_gb_dataset != new_is_one_gb_dataset);
+  const bool is_lpads_changed = m_mem_size != new_mem_size || m_is_one_gb_lpads != new_is_one_gb_lpads;
+  const bool is_setup_changed = m_batch != new_batch || m_threads != new_threads || is_lpads_changed ||
+                                m_seed_hex != new_seed_hex || m_algo_str != new_algo_str || is_rx_mode_changed;
+  // next pool job with the same setup is published to hashing threads without stopping them (they
+  // take it after their current hash), other jobs change hashing state and may tune rx with VMs
+  const bool is_switch = is_no_same_input && !is_setup_changed && m_cpus == new_cpus &&
+                         !(new_dev == DEV::RX_CPU && is_rx_tune && !m_is_rx_tuned);
+  if (!is_switch) {
+    stop_threads(); // old jobs use cn contexts and rx dataset
+    wait_rx_save(); // rx dataset file saving uses rx cache and dataset too
+  }
+  // other number of rx threads keeps rx cache, dataset, thread pool and VMs of the kept threads
+  const bool is_rx_resize = new_dev == DEV::RX_CPU && m_dev == DEV::RX_CPU && m_batch != new_batch &&
+                            m_algo_str == new_algo_str && !is_lpads_changed;
+  if (is_setup_changed) {
     // free previous memory
     free_memory(
-      m_batch != new_batch,
-      m_mem_size != new_mem_size,
+      (m_batch != new_batch || m_threads != new_threads) && !is_rx_resize,
+      is_lpads_changed,
       m_seed_hex.empty() && !new_seed_hex.empty(),
-      !m_seed_hex.empty() && new_seed_hex.empty()
+      (!m_seed_hex.empty() && new_seed_hex.empty()) || is_rx_mode_changed
     );
+    // rx VMs use rx config of their algo
+    if (m_algo_str != new_algo_str) free_rx_vms();
 
-    if (m_lpads == nullptr) m_lpads = alloc_huge_mem(new_batch * new_mem_size);
+    // rx threads use one scratchpad each and cn threads use one per batch item
+    const size_t new_lpad_num = new_dev == DEV::RX_CPU ? new_batch : new_threads * new_batch;
+    if (m_lpads == nullptr) m_lpads = alloc_huge_mem(new_lpad_num * new_mem_size, new_is_one_gb_lpads);
+    else if (m_lpads->size() < new_lpad_num * new_mem_size) { // more rx threads than scratchpads
+      xmrig::VirtualMemory* const lpads = alloc_huge_mem(new_lpad_num * new_mem_size, new_is_one_gb_lpads);
+      for (unsigned i = 0; i != m_vm.size(); ++ i)
+        randomx_vm_set_scratchpad(m_vm[i], lpads->scratchpad() + i * new_mem_size);
+      delete m_lpads; m_lpads = lpads;
+    }
+    if (m_thread_pool == nullptr) {
+      m_thread_pool = new ctpl::thread_pool(0);
+      m_jobs        = new JobSlot<HashJob>(RESULT_QUEUE_NUM);
+    }
+    // threads are only added (extra ones wait for jobs with more threads)
+    if (m_jobs->thread_num() < new_threads) {
+      m_thread_pool->resize(new_threads);
+      while (m_jobs->thread_num() < new_threads) {
+        const unsigned thread_id = m_jobs->add_thread();
+        m_thread_pool->push([this, thread_id](int) { hash_thread(thread_id); });
+      }
+    }
+    // soft AES implementation is selected for the number of rx threads
+    if (new_dev == DEV::RX_CPU && !ci.hasAES() && (m_dev != DEV::RX_CPU || m_batch != new_batch))
+      SelectSoftAESImpl(new_batch);
 
     if (new_dev == DEV::RX_CPU) {
+      // rx config is selected for this thread (caches and VMs created below keep it)
+      randomx_apply_config(*new_rx_config);
       // setup rx cache, dataset and thread_pool
       if (m_rx_cache_mem == nullptr)
         m_rx_cache_mem = alloc_huge_mem(RANDOMX_CACHE_MAX_SIZE);
-      if (m_rx_dataset_mem == nullptr)
-        m_rx_dataset_mem = alloc_huge_mem(RANDOMX_DATASET_MAX_SIZE);
-      if (m_rx_cache == nullptr) {
-        m_rx_cache = randomx_create_cache(RANDOMX_FLAG_JIT, m_rx_cache_mem->raw());
-        if (m_rx_cache == nullptr) {
-          m_is_rx_jit = false;
-          m_rx_cache = randomx_create_cache(RANDOMX_FLAG_DEFAULT, m_rx_cache_mem->raw());
-        }
+      // the first rx job of the process selects rx settings used by the caches and hashing
+      if (is_rx_tune) tune_rx_aes_init(new_seed);
+      if (m_rx_dataset_mem == nullptr && !new_is_rx_shared && !new_is_rx_light) {
+        m_rx_dataset_mem = alloc_huge_mem(RANDOMX_DATASET_MAX_SIZE, new_is_one_gb_dataset);
+        if (new_is_rx_numa) numa_nodes.bind(m_rx_dataset_mem->raw(), RANDOMX_DATASET_MAX_SIZE, 0);
       }
-      if (m_rx_dataset == nullptr)
+      if (m_rx_cache == nullptr) m_rx_cache = create_rx_cache(m_rx_cache_mem, m_is_rx_jit);
+      if (m_rx_dataset == nullptr && m_rx_dataset_mem)
         m_rx_dataset = randomx_create_dataset(m_rx_dataset_mem->raw());
-      if (m_thread_pool == nullptr) {
-        m_thread_pool = new ctpl::thread_pool(new_batch);
-        if (!ci.hasAES()) SelectSoftAESImpl(new_batch);
-      }
 
-      // recompute cache, dataset for new seed
-      if (m_seed_hex != new_seed_hex || m_algo_str != new_algo_str) {
-        randomx_apply_config(*new_rx_config);
+      // recompute cache, dataset for new seed (or use ones prepared in background), m_rx_next_dataset
+      // is only read for the prepared seed (wait_rx_prep was done for it above)
+      if (m_rx_next_seed_hex == new_seed_hex && m_algo_str == new_algo_str && m_rx_next_dataset) {
+        std::swap(m_rx_cache_mem,   m_rx_next_cache_mem);
+        std::swap(m_rx_dataset_mem, m_rx_next_dataset_mem);
+        std::swap(m_rx_cache,       m_rx_next_cache);
+        std::swap(m_rx_dataset,     m_rx_next_dataset);
+        m_rx_dataset_init_time = m_rx_next_init_time;
+        for (auto vm : m_vm) {
+          randomx_vm_set_cache(vm, m_rx_cache);
+          randomx_vm_set_dataset(vm, m_rx_dataset);
+        }
+        if (m_is_rx_next_built)
+          save_rx_dataset(get_rx_dataset_file_path(m_rx_dataset_dir, new_algo_str, new_seed_hex));
+        // old seed dataset memory is kept only if it is going to be used for the next seed
+        free_rx_next(!next_seed_hex.empty());
+      } else if (new_is_rx_light && (
+                   m_seed_hex != new_seed_hex || m_algo_str != new_algo_str || is_rx_mode_changed
+                 )
+      ) {
+        const uint64_t init_timestamp = xmrig::Chrono::steadyMSecs();
         randomx_init_cache(m_rx_cache, new_seed, HASH_LEN);
-        // init dataset in parallel threads
-        const unsigned rx_dataset_item_count = randomx_dataset_item_count(),
-                       thread_count          = std::thread::hardware_concurrency();
-        if (thread_count > 1) {
-          std::list<std::thread> threads;
-          for (unsigned i = 0; i < thread_count; ++i) {
-            const unsigned a = (rx_dataset_item_count * i) / thread_count,
-                           b = (rx_dataset_item_count * (i + 1)) / thread_count;
-            threads.emplace_back(init_rx_dataset_thread, m_rx_dataset, m_rx_cache, a, b - a);
+        m_rx_dataset_init_time = xmrig::Chrono::steadyMSecs() - init_timestamp;
+        // light VMs compile superscalar programs of the cache
+        for (auto vm : m_vm) randomx_vm_set_cache(vm, m_rx_cache);
+      } else if (new_is_rx_shared && (
+                   m_seed_hex != new_seed_hex || m_algo_str != new_algo_str || is_rx_mode_changed
+                 )
+      ) {
+        // only the first process that maps the dataset inits it
+        std::string name = new_algo_str + "-" + new_seed_hex;
+        std::replace(name.begin(), name.end(), '/', '_');
+        const std::string path = get_rx_dataset_file_path(m_rx_dataset_dir, new_algo_str, new_seed_hex);
+        const uint64_t init_timestamp = xmrig::Chrono::steadyMSecs();
+        bool is_built = false;
+        SharedMemory* const shared_dataset_mem = new SharedMemory(
+          name, RANDOMX_DATASET_MAX_SIZE, [&](uint8_t* const mem) {
+            randomx_dataset* const dataset = randomx_create_dataset(mem);
+            init_rx_dataset(dataset, m_rx_cache, new_seed, path, is_built);
+            randomx_release_dataset(dataset);
           }
-          for (auto& thread : threads) thread.join();
-        } else init_rx_dataset_thread(m_rx_dataset, m_rx_cache, 0, rx_dataset_item_count);
+        );
+        // old seed dataset is unmapped after VMs are switched to the new one
+        if (m_rx_dataset) randomx_release_dataset(m_rx_dataset);
+        m_rx_dataset = randomx_create_dataset(shared_dataset_mem->raw());
+        for (auto vm : m_vm) randomx_vm_set_dataset(vm, m_rx_dataset);
+        delete m_rx_shared_dataset_mem;
+        m_rx_shared_dataset_mem = shared_dataset_mem;
+        m_rx_dataset_init_time  = xmrig::Chrono::steadyMSecs() - init_timestamp;
+        if (is_built) save_rx_dataset(path);
+      } else if (m_seed_hex != new_seed_hex || m_algo_str != new_algo_str || is_rx_mode_changed) {
+        const std::string path = get_rx_dataset_file_path(m_rx_dataset_dir, new_algo_str, new_seed_hex);
+        bool is_built = false;
+        m_rx_dataset_init_time = init_rx_dataset(m_rx_dataset, m_rx_cache, new_seed, path, is_built);
+        if (is_built) save_rx_dataset(path);
       }
-      if (m_vm == nullptr) {
-        m_vm = new randomx_vm*[new_batch];
-        for (int i = 0; i != new_batch; ++ i) {
-          m_vm[i] = randomx_create_vm(
-            get_rx_vm_flags(m_is_rx_jit, m_rx_dataset, m_rx_dataset_mem), m_rx_cache, m_rx_dataset,
-            m_lpads->scratchpad() + i * new_mem_size, 0
-          );
+      if (new_is_rx_numa && (m_rx_node_datasets.empty() ||
+          m_seed_hex != new_seed_hex || m_algo_str != new_algo_str || is_rx_mode_changed)
+      ) replicate_rx_dataset(new_is_one_gb_dataset);
+      // VMs of removed threads are destroyed and VMs of added threads are created
+      while (m_vm.size() > new_batch) { randomx_destroy_vm(m_vm.back()); m_vm.pop_back(); }
+      if (m_vm.size() < new_batch) {
+        const bool is_huge_pages = m_rx_shared_dataset_mem ? m_rx_shared_dataset_mem->is_huge_pages() :
+                                   m_rx_dataset_mem ? get_page_size(m_rx_dataset_mem) > 4096 :
+                                   m_rx_cache_mem->isHugePages();
+        for (unsigned i = m_vm.size(); i != new_batch; ++ i) {
+          // VM memory is allocated from its NUMA node pool (its dataset is set after each job)
+          const unsigned node = new_is_rx_numa ? numa_nodes.cpu_node(new_cpus[i]) : 0;
+          const NumaNodes::MemoryPolicy policy(numa_nodes, node, new_is_rx_numa);
+          m_vm.push_back(randomx_create_vm(
+            get_rx_vm_flags(m_is_rx_jit, m_rx_dataset, is_huge_pages), m_rx_cache, m_rx_dataset,
+            m_lpads->scratchpad() + i * new_mem_size, node
+          ));
         }
       }
-    } else { // setup cn stuff
-      m_input_cn_len = new_inputs[0].size();
-      if (m_input_cn == nullptr) m_input_cn = static_cast<uint8_t*>(alloc_mem(new_batch * MAX_BLOB_LEN));
-      if (m_output == nullptr) m_output = static_cast<uint8_t*>(alloc_mem(new_batch * HASH_LEN));
-      if (m_spads == nullptr) m_spads = alloc_mem(new_batch * 200);
-      if (m_ctx == nullptr) {
-        m_ctx = new cryptonight_ctx*[new_batch];
-        xmrig::CnCtx::create(m_ctx, m_lpads->scratchpad(), new_mem_size, new_batch);
-      }
+    } else if (m_ctx == nullptr) { // setup cn contexts (m_batch of them for each thread)
+      m_ctx = new cryptonight_ctx*[new_lpad_num];
+      xmrig::CnCtx::create(m_ctx, m_lpads->scratchpad(), new_mem_size, new_lpad_num);
+    }
+    if (m_algo_str != new_algo_str || m_threads != new_threads) {
+      m_hashrate.reset(new_threads, xmrig::Chrono::steadyMSecs());
+      m_timestamp = xmrig::Chrono::steadyMSecs();
     }
-    if (m_algo_str != new_algo_str) set_fn(new_fn.any);
     m_batch    = new_batch;
+    m_threads  = new_threads;
     m_mem_size = new_mem_size;
     m_seed_hex = new_seed_hex;
     m_algo_str = new_algo_str;
+    m_is_rx_shared = new_is_rx_shared;
+    m_is_rx_light  = new_is_rx_light;
+    m_is_rx_numa   = new_is_rx_numa;
+    m_is_one_gb_dataset = new_is_one_gb_dataset;
+    m_is_one_gb_lpads   = new_is_one_gb_lpads;
   }
 
+  m_fn.any       = new_fn.any; // restore compute function stopped by a previous test job or error
   m_input_hex    = new_input_hex;
+  m_input_hexes  = std::move(new_input_hexes);
+  m_inputs       = std::move(new_inputs);
+  m_pool_id      = pool_id;
+  m_job_id       = job_id;
+  m_job_slot     = new_job_slot;
   m_dev          = new_dev;
   m_dev_str      = new_dev_str2;
   m_height       = new_height;
   m_nonce_offset = new_nonce_offset;
   m_is_nicehash  = new_nicehash;
+  m_is_set_nonce = is_set_nonce;
+  m_is_paused    = false; // new job also resumes paused hashing
   fn_extra_setup();
 
-  // start rx job compute threads
-  if (new_dev == DEV::RX_CPU) {
-    const unsigned job_ref = m_job_ref;
-    std::atomic<int> unique_counter{0};
-    for (unsigned batch_id = 0; batch_id != m_batch; ++batch_id) m_thread_pool->push(
-      [=, &m_job_ref = m_job_ref, &m_hash_count = m_hash_count, &unique_counter](int) {
-        const int thread_id = unique_counter.fetch_add(1);
-        try {
-          alignas(16) uint8_t  input[MAX_BLOB_LEN];
-          alignas(16) uint8_t  output[HASH_LEN];
-          alignas(16) uint64_t temp_hash[8];
-          uint32_t nonce = new_nonce + new_thread_id * m_batch + batch_id;
-          if (m_is_nicehash) nonce |= *get_nonce(new_inputs[thread_id].data()) & 0xFF000000;
-          const unsigned nonce_step = new_thread_num * m_batch;
-          unsigned hashrate_update_counter = HASHRATE_COUNTER_INTERVAL;
-	  const unsigned input_len = new_inputs[thread_id].size();
-          memcpy(input, new_inputs[thread_id].data(), input_len);
-          if (is_set_nonce) { *get_nonce(input) = nonce; nonce += nonce_step; }
-          randomx_calculate_hash_first(m_vm[thread_id], temp_hash, input, input_len);
-          while (job_ref == m_job_ref) { // continue until we get a new job
-            uint32_t* const pnonce = get_nonce(input);
-            const uint32_t prev_nonce = nonce;
-            *pnonce = (nonce += nonce_step);
-            if (m_target && ( m_is_nicehash ? (prev_nonce & 0xFF000000) != (nonce & 0xFF000000) :
-                              prev_nonce > nonce )
-            ) {
-              send_error("Nonce overflow");
-              break; // will also effectively stops this thread
-            }
-            randomx_calculate_hash_next(m_vm[thread_id], temp_hash, input, input_len, output);
-
-            if (!is_set_nonce) { // test job
-              char hash[HASH_LEN*2+1];
-              MessageValues values;
-              values["result"] = hash_bin2hex(output, hash);
-              values["input"]  = new_input_hexes[thread_id];
-	      values["rx_thread_id"] = std::to_string(thread_id);
-              values["job_id"] = job_id;
-              send_msg("test", values);
-              break;
-            }
-            if (--hashrate_update_counter == 0) {
-              hashrate_update_counter = HASHRATE_COUNTER_INTERVAL;
-              m_mutex_hashrate.lock();
-              m_hash_count += HASHRATE_COUNTER_INTERVAL;
-              m_mutex_hashrate.unlock();
-            }
-            if (m_target && *get_result(output) < m_target)
-              send_result(nonce - nonce_step, output);
-          }
-          // only send for mine jobs
-          if (m_target) send_last_nonce(nonce, m_pool_id);
-        } catch(const std::string& err) {
-          send_error(std::string("Compute function thread exception: ") + err);
-        } catch(...) {
-          send_error("Compute function thread exception");
+  m_cpus   = new_cpus;
+  // nonce blocks are interleaved with cores of other threads (thread_id of thread_num)
+  m_nonces = NonceCounter::get(
+    m_pool_id + " " + m_job_id + " " + m_input_hex, new_nonce, m_is_nicehash ? 0x00FFFFFF : 0xFFFFFFFF,
+    new_thread_id, new_thread_num
+  );
+  // MSR preset only helps rx algos (and it is applied before rx settings are tuned with it)
+  set_msr(is_msr && m_dev == DEV::RX_CPU);
+  // the first full rx job of the core also selects the fastest prefetch mode for this CPU
+  if (m_dev == DEV::RX_CPU && m_rx_dataset && is_rx_tune && !m_is_rx_tuned) tune_rx(new_seed);
+  if (m_is_rx_numa && !is_switch) set_rx_vm_datasets(); // threads may be pinned to other CPUs now
+  start_threads();
+
+  // next seed dataset is built in background so seed change will be just a dataset swap
+  if (new_dev == DEV::RX_CPU && !next_seed_hex.empty() && next_seed_hex != m_seed_hex &&
+      next_seed_hex != m_rx_next_seed_hex && !m_is_rx_shared && !m_is_rx_light
+  ) prepare_rx_dataset(next_seed_hex, next_seed, true);
+}
+
+void Core::prepare_rx_dataset(
+  const std::string& seed_hex, const uint8_t* const seed, const bool is_idle
+) {
+  std::array<uint8_t, HASH_LEN> seed2;
+  memcpy(seed2.data(), seed, HASH_LEN);
+  m_rx_next_seed_hex = seed_hex;
+  // uses current rx config so it is only done for the same algo
+  const std::string path = get_rx_dataset_file_path(m_rx_dataset_dir, m_algo_str, seed_hex);
+  m_rx_prep_threads.set_idle(is_idle);
+  // init threads are only created by this thread (init_rx_dataset creates them for foreground inits
+  // after background ones are done)
+  if (m_rx_init_pool == nullptr) m_rx_init_pool = new ctpl::thread_pool(std::thread::hardware_concurrency());
+  const bool is_numa = m_is_rx_numa, is_one_gb_dataset = m_is_one_gb_dataset;
+  RandomX_ConfigurationBase* const config = RandomX_CurrentConfigPtr;
+  m_rx_prep = std::async(std::launch::async, [this, seed2, path, is_numa, is_one_gb_dataset, config]() {
+    try {
+      RandomX_CurrentConfigPtr = config;
+      if (m_rx_next_cache_mem == nullptr)
+        m_rx_next_cache_mem = alloc_huge_mem(RANDOMX_CACHE_MAX_SIZE);
+      if (m_rx_next_dataset_mem == nullptr) {
+        m_rx_next_dataset_mem = alloc_huge_mem(RANDOMX_DATASET_MAX_SIZE, is_one_gb_dataset);
+        if (is_numa) numa_nodes.bind(m_rx_next_dataset_mem->raw(), RANDOMX_DATASET_MAX_SIZE, 0);
+      }
+      if (m_rx_next_cache == nullptr) {
+        bool is_rx_jit = m_is_rx_jit;
+        m_rx_next_cache = create_rx_cache(m_rx_next_cache_mem, is_rx_jit);
+        if (is_rx_jit != m_is_rx_jit) throw std::string("Can't create JIT rx cache");
+      }
+      if (m_rx_next_dataset == nullptr)
+        m_rx_next_dataset = randomx_create_dataset(m_rx_next_dataset_mem->raw());
+      m_rx_next_init_time = init_rx_dataset(
+        m_rx_next_dataset, m_rx_next_cache, seed2.data(), path, m_is_rx_next_built, &m_rx_prep_threads
+      );
+      return std::string();
+    } catch(const std::string& err) {
+      return err;
+    }
+  });
+}
+
+void Core::wait_rx_prep() {
+  if (!m_rx_prep.valid()) return;
+  m_rx_prep_threads.set_idle(false); // do not wait for idle priority threads
+  const std::string err = m_rx_prep.get();
+  if (err.empty()) return;
+  m_rx_next_seed_hex.clear();
+  send_error("RX dataset preparation exception: " + err);
+}
+
+// inits rx cache and dataset for the seed in m_rx_init_pool threads that take dataset item chunks
+// until all are done (so slower CPUs do less work) and returns init time (ms), all used threads
+// are registered in idle_threads (if it is given for background init)
+uint64_t Core::init_rx_dataset(
+  randomx_dataset* const dataset, randomx_cache* const cache, const uint8_t* const seed,
+  IdleThreads* const idle_threads
+) {
+  // foreground init chunks would wait behind the idle priority ones of background init, so it is
+  // finished first at normal priority
+  if (idle_threads == nullptr) wait_rx_prep();
+  const uint64_t init_timestamp = xmrig::Chrono::steadyMSecs();
+  {
+    IdleThreads::Guard idle_thread(idle_threads);
+    randomx_init_cache(cache, seed, HASH_LEN);
+  }
+  const unsigned item_count  = randomx_dataset_item_count(),
+                 chunk_count = (item_count + RX_DATASET_INIT_CHUNK - 1) / RX_DATASET_INIT_CHUNK,
+                 thread_count = std::thread::hardware_concurrency();
+  if (m_rx_init_pool == nullptr) m_rx_init_pool = new ctpl::thread_pool(thread_count);
+  std::atomic<unsigned> next_chunk(0), done_chunks(0);
+  std::vector<std::future<void> > threads;
+  for (unsigned i = 0; i != thread_count; ++i) threads.push_back(m_rx_init_pool->push([&](int id) {
+    pin_thread(id);
+    IdleThreads::Guard idle_thread(idle_threads);
+    // only the last chunk is not a multiple of RX_DATASET_INIT_ALIGN items
+    for (unsigned chunk; (chunk = next_chunk++) < chunk_count; ++ done_chunks) {
+      const unsigned start = chunk * RX_DATASET_INIT_CHUNK;
+      init_rx_dataset_thread(dataset, cache, start, std::min(RX_DATASET_INIT_CHUNK, item_count - start));
+    }
+  }));
+  char seed_hex[HASH_LEN*2+1];
+  MessageValues values;
+  values["seed_hex"]  = hash_bin2hex(seed, seed_hex);
+  values["is_loaded"] = "0";
+  for (auto& thread : threads) {
+    while (thread.wait_for(std::chrono::milliseconds(DATASET_PROGRESS_INTERVAL)) != std::future_status::ready) {
+      values["progress"] = std::to_string(done_chunks * 100 / chunk_count);
+      values["time"]     = std::to_string(xmrig::Chrono::steadyMSecs() - init_timestamp);
+      send_msg("dataset_progress", values);
+    }
+  }
+  const uint64_t init_time = xmrig::Chrono::steadyMSecs() - init_timestamp;
+  values["progress"] = "100";
+  values["time"]     = std::to_string(init_time);
+  send_msg("dataset_progress", values);
+  return init_time;
+}
+
+// inits rx cache and dataset for the seed from its dataset file (if path is not empty and file is
+// valid) or computes them (then is_built is set) and returns init time (ms), loaded dataset is
+// reported by dataset_progress message with is_loaded set
+uint64_t Core::init_rx_dataset(
+  randomx_dataset* const dataset, randomx_cache* const cache, const uint8_t* const seed,
+  const std::string& path, bool& is_built, IdleThreads* const idle_threads
+) {
+  const uint64_t init_timestamp = xmrig::Chrono::steadyMSecs();
+  is_built = !load_rx_dataset(dataset, cache, seed, path);
+  if (is_built) init_rx_dataset(dataset, cache, seed, idle_threads);
+  const uint64_t init_time = xmrig::Chrono::steadyMSecs() - init_timestamp;
+  if (!is_built) {
+    char seed_hex[HASH_LEN*2+1];
+    MessageValues values;
+    values["seed_hex"]  = hash_bin2hex(seed, seed_hex);
+    values["is_loaded"] = "1";
+    values["progress"]  = "100";
+    values["time"]      = std::to_string(init_time);
+    send_msg("dataset_progress", values);
+  }
+  return init_time;
+}
+
+// saves current rx cache and dataset to the dataset file in background
+void Core::save_rx_dataset(const std::string& path) {
+  if (path.empty()) return;
+  wait_rx_save();
+  const std::vector<DatasetFile::Block> blocks = get_rx_dataset_blocks(m_rx_dataset, m_rx_cache);
+  m_rx_save = std::async(std::launch::async, [blocks, path]() {
+    return DatasetFile::save(path, blocks) ? std::string() : "Can't save RX dataset file " + path;
+  });
+}
+
+// copies rx dataset to its other NUMA node copies by threads pinned to CPUs of these nodes
+void Core::replicate_rx_dataset(const bool is_one_gb_pages) {
+  const size_t size = randomx_dataset_item_count() * static_cast<size_t>(RANDOMX_DATASET_ITEM_SIZE);
+  const uint8_t* const src = static_cast<const uint8_t*>(randomx_get_dataset_memory(m_rx_dataset));
+  std::list<std::thread> threads;
+  for (unsigned node = 1; node < numa_nodes.size(); ++node) {
+    if (m_rx_node_datasets.size() < node) {
+      xmrig::VirtualMemory* mem;
+      {
+        const NumaNodes::MemoryPolicy policy(numa_nodes, node);
+        mem = alloc_huge_mem(RANDOMX_DATASET_MAX_SIZE, is_one_gb_pages);
+      }
+      numa_nodes.bind(mem->raw(), RANDOMX_DATASET_MAX_SIZE, node);
+      m_rx_node_dataset_mems.push_back(mem);
+      m_rx_node_datasets.push_back(randomx_create_dataset(mem->raw()));
+    }
+    uint8_t* const dst = static_cast<uint8_t*>(randomx_get_dataset_memory(m_rx_node_datasets[node - 1]));
+    const std::vector<unsigned>& cpus = numa_nodes.cpus(node);
+    for (unsigned i = 0; i != cpus.size(); ++i) {
+      const size_t a = size * i / cpus.size(), b = size * (i + 1) / cpus.size();
+      const unsigned cpu = cpus[i];
+      threads.emplace_back([=]() {
+        pin_thread(cpu);
+        memcpy(dst + a, src + a, b - a);
+      });
+    }
+  }
+  for (auto& thread : threads) thread.join();
+}
+
+// points rx VMs to the dataset copy of NUMA node of CPU their threads are pinned to
+void Core::set_rx_vm_datasets() {
+  for (unsigned i = 0; i != m_batch; ++ i)
+    randomx_vm_set_dataset(m_vm[i], get_rx_node_dataset(numa_nodes.cpu_node(m_cpus[i])));
+}
+
+// best (minimal) times of RX_TUNE_ROUNDS fn(variant) calls for each variant (us), variants are
+// interleaved in rounds after one warm up round so they are affected by CPU state changes evenly
+static std::vector<uint64_t> get_rx_tune_times(
+  const unsigned variant_num, const std::function<void(unsigned)>& fn
+) {
+  std::vector<uint64_t> best_times(variant_num, UINT64_MAX);
+  for (unsigned round = 0; round <= RX_TUNE_ROUNDS; ++round) {
+    for (unsigned variant = 0; variant != variant_num; ++variant) {
+      const auto start = std::chrono::steady_clock::now();
+      fn(variant);
+      const uint64_t time = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start
+      ).count();
+      if (round) best_times[variant] = std::min(best_times[variant], std::max(time, static_cast<uint64_t>(1)));
+    }
+  }
+  return best_times;
+}
+
+// rx tune file of the dataset dir (or of the temp dir) shared by processes of this host with
+// "<prefetch mode> <dataset init> <hard AES impl> <CPU model>" lines. It is locked while it is
+// read, timed and saved, so processes started at once time rx settings once and not concurrently.
+class RxTuneFile {
+public:
+  explicit RxTuneFile(const std::string& dir) : m_path(get_path(dir)) {
+#   if defined(__linux__)
+    m_fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (m_fd != -1) while (flock(m_fd, LOCK_EX) == -1 && errno == EINTR);
+#   endif
+    load();
+  }
+  ~RxTuneFile() {
+#   if defined(__linux__)
+    if (m_fd != -1) close(m_fd); // also unlocks it
+#   endif
+  }
+
+  // writes all rx_tunes (the file is changed in place since other processes lock it)
+  void save() const {
+    std::ostringstream stream;
+    for (const auto& tune : rx_tunes)
+      stream << tune.second.prefetch_mode << ' ' << tune.second.dataset_init << ' ' << tune.second.aes_impl
+             << ' ' << tune.first << '\n';
+    const std::string data = stream.str();
+#   if defined(__linux__)
+    if (m_fd == -1 || ftruncate(m_fd, 0)) return;
+    if (pwrite(m_fd, data.data(), data.size(), 0) != static_cast<ssize_t>(data.size())) return;
+#   else
+    std::ofstream file(m_path, std::ios::trunc);
+    file << data;
+#   endif
+  }
+
+private:
+  static std::string get_path(const std::string& dir) {
+    if (!dir.empty()) return dir + "/" + RX_TUNE_FILE_NAME;
+    std::error_code error;
+    const std::filesystem::path temp_dir = std::filesystem::temp_directory_path(error);
+    return (error ? std::filesystem::path(".") : temp_dir) / RX_TUNE_FILE_NAME;
+  }
+
+  // file lines replace rx_tunes of this process (they can be timed by other processes since)
+  void load() {
+    std::ifstream file(m_path);
+    std::string line;
+    while (std::getline(file, line)) {
+      std::istringstream stream(line);
+      RxTune tune;
+      std::string cpu;
+      if (!(stream >> tune.prefetch_mode >> tune.dataset_init >> tune.aes_impl) ||
+          !std::getline(stream >> std::ws, cpu)) continue;
+      if (tune.prefetch_mode < -1 || tune.prefetch_mode > 3 || tune.dataset_init < -1 || tune.dataset_init > 2 ||
+          tune.aes_impl < -1 || tune.aes_impl > 2) continue;
+      rx_tunes[cpu] = tune;
+    }
+  }
+
+  const std::string m_path;
+#  if defined(__linux__)
+  int m_fd = -1;
+#  endif
+};
+
+// selects the fastest hard AES implementation (by scratchpad hashing and filling) and dataset
+// init variant (by dataset items inited by temporary JIT caches of m_rx_cache_mem) for this CPU
+// model, or ones timed before by this or other process. It is only done before the first rx cache
+// of the process is created, so these settings do not change under hashing or dataset init.
+void Core::tune_rx_aes_init(const uint8_t* const seed) {
+  std::lock_guard<std::mutex> lock(rx_tune_mutex);
+  if (is_rx_aes_init_selected) return;
+  is_rx_aes_init_selected = true; // caches of other cores wait for rx_tune_mutex
+  const std::string cpu = ci.brand();
+  RxTuneFile file(m_rx_dataset_dir);
+  auto pi = rx_tunes.try_emplace(cpu, RxTune{ -1, -1, -1 }).first;
+  if (pi->second.dataset_init < 0 || pi->second.aes_impl < 0) {
+    RxTune tune = { pi->second.prefetch_mode, 0, 0 };
+    std::string aes_rates, init_rates;
+    // VAES variants (see GetHardAESImpl) with output that differs from AES-NI one are not used
+    if (ci.hasAES()) {
+      // impls are called directly since rx code of other threads reads the selected one
+      const unsigned impl_num = GetHardAESImpl(2).impl + 1;
+      const size_t spad_size = RandomX_CurrentConfig.ScratchpadL3_Size;
+      xmrig::VirtualMemory* const spad_mem = alloc_huge_mem(spad_size);
+      uint8_t* const spad = spad_mem->scratchpad();
+      std::vector<std::vector<uint8_t>> outputs(impl_num);
+      for (unsigned impl = 0; impl != impl_num; ++impl) {
+        const HardAESImpl fn = GetHardAESImpl(impl);
+        alignas(64) uint8_t state[64] = {}, hash[64];
+        memcpy(state, seed, HASH_LEN);
+        fillAes1Rx4<0>(state, spad_size, spad);
+        fn.hashAndFill(spad, spad_size, hash, state);
+        std::vector<uint8_t>& output = outputs[impl];
+        output.assign(hash, hash + sizeof(hash));
+        output.insert(output.end(), state, state + sizeof(state));
+        fn.hash(spad, spad_size, hash);
+        output.insert(output.end(), hash, hash + sizeof(hash));
+        fn.fill(hash, 512, spad);
+        output.insert(output.end(), spad, spad + 512);
+      }
+      // <0, 2> is the only hard AES unroll variant (the one VMs call), other ones are soft AES
+      const std::vector<uint64_t> aes_times = get_rx_tune_times(impl_num, [&](const unsigned impl) {
+        hashAndFillAes1Rx4_impl* const hash_and_fill = GetHardAESImpl(impl).hashAndFill;
+        alignas(64) uint8_t state[64] = {}, hash[64];
+        for (unsigned i = 0; i != RX_TUNE_AES_SPADS; ++i) hash_and_fill(spad, spad_size, hash, state);
+      });
+      for (unsigned impl = 0; impl != impl_num; ++impl) {
+        if (outputs[impl] == outputs[0] && aes_times[impl] < aes_times[tune.aes_impl]) tune.aes_impl = impl;
+        if (impl) aes_rates += " ";
+        aes_rates += outputs[impl] == outputs[0] ? std::to_string(RX_TUNE_AES_SPADS * 1000000ULL / aes_times[impl]) : "0";
+      }
+      delete spad_mem;
+    }
+    // dataset init variants only differ for JIT caches (1 is AVX2 code, 2 is AVX-512 code)
+    if (m_is_rx_jit && ci.hasAVX2()) {
+      const unsigned init_num = ci.has(xmrig::ICpuInfo::FLAG_AVX512F) ? 3 : 2;
+      xmrig::VirtualMemory* const items_mem = alloc_huge_mem(RX_TUNE_INIT_ITEMS * RANDOMX_DATASET_ITEM_SIZE);
+      randomx_dataset* const dataset = randomx_create_dataset(items_mem->raw());
+      std::vector<randomx_cache*> caches(init_num, nullptr);
+      for (unsigned init = 0; init != init_num; ++init) {
+        randomx_set_optimized_dataset_init(init);
+        caches[init] = randomx_create_cache(RANDOMX_FLAG_JIT, m_rx_cache_mem->raw());
+        if (caches[init]) compile_rx_cache(caches[init], seed);
+      }
+      if (std::find(caches.begin(), caches.end(), nullptr) == caches.end()) {
+        const std::vector<uint64_t> init_times = get_rx_tune_times(init_num, [&](const unsigned init) {
+          randomx_init_dataset(dataset, caches[init], 0, RX_TUNE_INIT_ITEMS);
+        });
+        for (unsigned init = 0; init != init_num; ++init) {
+          if (init_times[init] < init_times[tune.dataset_init]) tune.dataset_init = init;
+          if (init) init_rates += " ";
+          init_rates += std::to_string(RX_TUNE_INIT_ITEMS * 1000000ULL / init_times[init]);
         }
       }
-    );
-  } else {
-    m_nonce = new_nonce + new_thread_id;
-    if (m_is_nicehash) m_nonce |= *get_nonce(new_inputs[0].data()) & 0xFF000000;
-    m_nonce_step = new_thread_num;
-    for (unsigned i = 0; i != m_batch; ++i) {
-      memcpy(m_input_cn + m_input_cn_len*i, new_inputs[0].data(), m_input_cn_len);
-      if (is_set_nonce) { *get_nonce_cn(i) = m_nonce; m_nonce += m_nonce_step; }
+      for (auto cache : caches) if (cache) randomx_release_cache(cache);
+      randomx_release_dataset(dataset);
+      delete items_mem;
     }
+    pi->second = tune;
+    file.save();
+    rx_tune_rates["aes_rates"]  = aes_rates;  // scratchpads/s of one thread for hard AES impls (0 if wrong)
+    rx_tune_rates["init_rates"] = init_rates; // dataset items/s of one thread for init variants 0-2
   }
+  randomx_set_optimized_dataset_init(pi->second.dataset_init);
+  SelectHardAESImpl(pi->second.aes_impl);
+}
+
+// selects the fastest scratchpad prefetch mode (by hashes of m_vm[0] over the real dataset) for
+// this CPU model, or one timed before by this or other process, and sends rx_tune message. It is
+// done before hashing threads of this core are started. Other cores keep hashing with their
+// configs since each prefetch mode has its own applied rx config.
+void Core::tune_rx(const uint8_t* const seed) {
+  std::lock_guard<std::mutex> lock(rx_tune_mutex);
+  const std::string cpu = ci.brand();
+  MessageValues values = rx_tune_rates;
+  RxTuneFile file(m_rx_dataset_dir);
+  auto pi = rx_tunes.try_emplace(cpu, RxTune{ -1, -1, -1 }).first;
+  if (pi->second.prefetch_mode >= 0) values["is_cached"] = "1";
+  else {
+    std::string hashrates;
+    int prefetch_mode = 0;
+    const std::vector<uint64_t> hash_times = get_rx_tune_times(4, [&](const unsigned mode) {
+      randomx_set_scratchpad_prefetch_mode(mode);
+      randomx_select_config(RandomX_CurrentConfig); // config applied with new mode for JIT program code
+      m_vm[0]->rxConfig = RandomX_CurrentConfigPtr;
+      uint8_t output[HASH_LEN];
+      for (unsigned i = 0; i != RX_TUNE_HASHES; ++i) randomx_calculate_hash(m_vm[0], seed, HASH_LEN, output);
+    });
+    for (unsigned mode = 0; mode != hash_times.size(); ++mode) {
+      if (hash_times[mode] < hash_times[prefetch_mode]) prefetch_mode = mode;
+      if (mode) hashrates += " ";
+      hashrates += std::to_string(RX_TUNE_HASHES * 1000000ULL / hash_times[mode]);
+    }
+    pi->second.prefetch_mode = prefetch_mode;
+    file.save();
+    values["hashrates"] = hashrates; // H/s of one thread for prefetch modes 0-3
+  }
+  randomx_set_scratchpad_prefetch_mode(pi->second.prefetch_mode);
+  randomx_select_config(RandomX_CurrentConfig);
+  for (auto vm : m_vm) vm->rxConfig = RandomX_CurrentConfigPtr; // no hashing threads use them yet
+  m_is_rx_tuned = true;
+  values["cpu"]           = cpu;
+  values["prefetch_mode"] = std::to_string(pi->second.prefetch_mode);
+  values["dataset_init"]  = std::to_string(pi->second.dataset_init);
+  values["aes_impl"]      = std::to_string(pi->second.aes_impl);
+  send_msg("rx_tune", values);
+}
+
+void Core::wait_rx_save() {
+  if (!m_rx_save.valid()) return;
+  const std::string err = m_rx_save.get();
+  if (!err.empty()) send_error(err);
+}
+
+void Core::free_rx_next(const bool is_keep_memory) {
+  m_rx_next_seed_hex.clear();
+  if (is_keep_memory) return;
+  if (m_rx_next_dataset)     { randomx_release_dataset(m_rx_next_dataset); m_rx_next_dataset = nullptr; }
+  if (m_rx_next_cache)       { randomx_release_cache(m_rx_next_cache); m_rx_next_cache = nullptr; }
+  if (m_rx_next_dataset_mem) { delete m_rx_next_dataset_mem; m_rx_next_dataset_mem = nullptr; }
+  if (m_rx_next_cache_mem)   { delete m_rx_next_cache_mem; m_rx_next_cache_mem = nullptr; }
+}
+
+// rx cache of the verify seed from the LRU list that is moved to its front (new seed cache is
+// inited and replaces the least recently used one), in full mode the seed also gets its dataset
+// (only one verify dataset is kept since it is 2 GB)
+Core::RxVerifySeed& Core::get_rx_verify_seed(
+  const std::string& algo_str, const std::string& seed_hex, const uint8_t* const seed,
+  const bool is_full
+) {
+  const auto it = std::find_if(m_rx_verify_seeds.begin(), m_rx_verify_seeds.end(),
+    [&](const RxVerifySeed& rx_seed) { return rx_seed.algo_str == algo_str && rx_seed.seed_hex == seed_hex; }
+  );
+  const bool is_new = it == m_rx_verify_seeds.end();
+  if (is_new) {
+    if (m_rx_verify_seeds.size() == RX_VERIFY_CACHE_NUM) {
+      RxVerifySeed& rx_seed = m_rx_verify_seeds.back();
+      free_rx_verify_dataset(rx_seed);
+      randomx_release_cache(rx_seed.cache);
+      delete rx_seed.cache_mem;
+      m_rx_verify_seeds.pop_back();
+    }
+    xmrig::VirtualMemory* const cache_mem = alloc_huge_mem(RANDOMX_CACHE_MAX_SIZE);
+    randomx_cache* const cache = create_rx_cache(cache_mem, m_is_rx_verify_jit);
+    m_rx_verify_seeds.push_front({ algo_str, seed_hex, cache_mem, nullptr, cache, nullptr });
+  } else m_rx_verify_seeds.splice(m_rx_verify_seeds.begin(), m_rx_verify_seeds, it);
+  RxVerifySeed& rx_seed = m_rx_verify_seeds.front();
+  if (is_full && rx_seed.dataset == nullptr) {
+    for (auto& rx_seed2 : m_rx_verify_seeds) free_rx_verify_dataset(rx_seed2);
+    rx_seed.dataset_mem = alloc_huge_mem(RANDOMX_DATASET_MAX_SIZE);
+    rx_seed.dataset     = randomx_create_dataset(rx_seed.dataset_mem->raw());
+    init_rx_dataset(rx_seed.dataset, rx_seed.cache, seed); // also inits cache
+  } else if (is_new) randomx_init_cache(rx_seed.cache, seed, HASH_LEN);
+  return rx_seed;
+}
+
+// computes rx hashes of blob_hex lines with their seed_hex lines (or one seed_hex for all of them)
+// by m_verify_pool threads in light (default) or full ("cpu" dev) mode and sends them in one reply
+void Core::verify(const MessageValues& v) {
+  if (!v.contains("algo"))     throw std::string("Missing algo verify key");
+  if (!v.contains("blob_hex")) throw std::string("Missing blob_hex verify key");
+  if (!v.contains("seed_hex")) throw std::string("Missing seed_hex verify key");
+  const std::string algo_str = v.at("algo"),
+                    dev_str  = v.contains("dev") ? v.at("dev") : std::string("cpu-light");
+  const auto pi = rx_cpu_name2config.find(algo_str);
+  if (pi == rx_cpu_name2config.end()) throw std::string("Unsupported algo");
+  if (dev_str != "cpu" && dev_str != "cpu-light") throw std::string("Invalid dev specification");
+  const bool is_full = dev_str == "cpu";
+  const std::vector<std::string> blob_hexes = split_input(v.at("blob_hex")),
+                                 seed_hexes = split_input(v.at("seed_hex"));
+  if (blob_hexes.empty()) throw std::string("No blob_hex lines");
+  if (seed_hexes.size() != 1 && seed_hexes.size() != blob_hexes.size())
+    throw std::string("Bad seed_hex line number");
+
+  std::vector<std::vector<uint8_t> > blobs;
+  std::map<std::string, std::vector<unsigned> > seed2blobs; // blob indexes of each seed
+  for (unsigned i = 0; i != blob_hexes.size(); ++i) {
+    const std::string& blob_hex = blob_hexes[i];
+    if (blob_hex.size() % 2 || blob_hex.size() / 2 > MAX_BLOB_LEN) throw std::string("Bad blob length");
+    blobs.emplace_back(blob_hex.size() / 2);
+    if (!hex2bin(blob_hex.c_str(), blobs.back().size(), blobs.back().data())) throw std::string("Bad blob hex");
+    seed2blobs[seed_hexes[seed_hexes.size() == 1 ? 0 : i]].push_back(i);
+  }
+  std::vector<std::array<uint8_t, HASH_LEN> > seeds;
+  for (const auto& seed2blob : seed2blobs) {
+    seeds.emplace_back();
+    if (seed2blob.first.size() != HASH_LEN * 2) throw std::string("Bad seed length");
+    if (!hex2bin(seed2blob.first.c_str(), HASH_LEN, seeds.back().data())) throw std::string("Bad seed hex");
+  }
+
+  const uint64_t timestamp = xmrig::Chrono::steadyMSecs();
+  // rx config of the current job is selected back after verification
+  struct ConfigGuard {
+    RandomX_ConfigurationBase* const m_config = RandomX_CurrentConfigPtr;
+    ~ConfigGuard() { RandomX_CurrentConfigPtr = m_config; }
+  } config_guard;
+  randomx_apply_config(*pi->second);
+  const unsigned thread_count = std::thread::hardware_concurrency();
+  if (m_verify_pool == nullptr) m_verify_pool = new ctpl::thread_pool(thread_count);
+  if (m_rx_verify_lpads == nullptr)
+    m_rx_verify_lpads = alloc_huge_mem(thread_count * RANDOMX_SCRATCHPAD_L3_MAX_SIZE);
+  if (m_rx_verify_algo_str != algo_str || m_is_rx_verify_full != is_full) free_rx_verify_vms();
+  m_rx_verify_algo_str = algo_str;
+  m_is_rx_verify_full  = is_full;
+
+  std::vector<uint8_t> hashes(blobs.size() * HASH_LEN);
+  unsigned seed_index = 0;
+  for (const auto& seed2blob : seed2blobs) {
+    const std::vector<unsigned>& items = seed2blob.second;
+    const RxVerifySeed& rx_seed = get_rx_verify_seed(algo_str, seed2blob.first, seeds[seed_index++].data(), is_full);
+    std::vector<std::future<void> > threads;
+    if (m_rx_verify_vms.empty()) {
+      const bool is_huge_pages = (rx_seed.dataset ? rx_seed.dataset_mem : rx_seed.cache_mem)->isHugePages();
+      for (unsigned i = 0; i != thread_count; ++i) m_rx_verify_vms.push_back(randomx_create_vm(
+        get_rx_vm_flags(m_is_rx_verify_jit, rx_seed.dataset, is_huge_pages), rx_seed.cache, rx_seed.dataset,
+        m_rx_verify_lpads->scratchpad() + i * RANDOMX_SCRATCHPAD_L3_MAX_SIZE, 0
+      ));
+    } else if (m_rx_verify_seed_hex != seed2blob.first) {
+      // light VMs compile superscalar programs of the cache so it is done by all threads
+      for (const auto vm : m_rx_verify_vms) threads.push_back(m_verify_pool->push([&, vm](int) {
+        randomx_vm_set_cache(vm, rx_seed.cache);
+        if (rx_seed.dataset) randomx_vm_set_dataset(vm, rx_seed.dataset);
+      }));
+      for (auto& thread : threads) thread.get();
+      threads.clear();
+    }
+    m_rx_verify_seed_hex = seed2blob.first;
+    // tasks that run at the same time have different pool thread ids (so they use different VMs)
+    std::atomic<unsigned> next_item(0);
+    for (unsigned i = 0; i != thread_count; ++i) threads.push_back(m_verify_pool->push([&](int id) {
+      for (unsigned i; (i = next_item++) < items.size();) {
+        const unsigned item = items[i];
+        randomx_calculate_hash(m_rx_verify_vms[id], blobs[item].data(), blobs[item].size(), hashes.data() + item * HASH_LEN);
+      }
+    }));
+    for (auto& thread : threads) thread.get();
+  }
+
+  std::string result;
+  for (unsigned i = 0; i != blobs.size(); ++i) {
+    if (i) result += " ";
+    char hash[HASH_LEN*2+1];
+    result += hash_bin2hex(hashes.data(), hash, i);
+  }
+  MessageValues values;
+  values["result"] = result;
+  values["time"]   = std::to_string(xmrig::Chrono::steadyMSecs() - timestamp);
+  if (v.contains("verify_id")) values["verify_id"] = v.at("verify_id");
+  send_msg("verify", values);
+}
+
+// publishes job of current job settings to hashing threads
+void Core::start_threads() {
+  std::unique_ptr<HashJob> job(new HashJob);
+  job->dev          = m_dev;
+  job->fn           = m_fn;
+  job->input_hexes  = m_input_hexes;
+  job->inputs       = m_inputs;
+  job->cpus         = m_cpus;
+  // all threads of a cn test job would compute the same hash
+  job->threads      = m_dev == DEV::RX_CPU || m_is_set_nonce ? m_threads : 1;
+  job->nonces       = m_nonces;
+  job->target       = m_target;
+  job->batch        = m_batch;
+  job->height       = m_height;
+  job->nonce_offset = m_nonce_offset;
+  job->job_slot     = m_job_slot;
+  job->is_nicehash  = m_is_nicehash;
+  job->is_set_nonce = m_is_set_nonce;
+  job->pool_id      = m_pool_id;
+  job->job_id       = m_job_id;
+  m_jobs->publish(std::move(job));
+}
+
+// persistent m_thread_pool thread that hashes published jobs until the pool is freed
+void Core::hash_thread(const unsigned thread_id) {
+  unsigned cpu = UINT_MAX;
+  uint64_t seq = 0;
+  while (HashJob* const job = m_jobs->next(thread_id, seq)) {
+    if (thread_id >= job->threads) continue;
+    if (job->cpus[thread_id] != cpu) pin_thread(cpu = job->cpus[thread_id]);
+    try {
+      if (job->dev == DEV::RX_CPU) hash_rx(*job, thread_id, seq);
+      else hash_cn(*job, thread_id, seq);
+    } catch(const std::string& err) {
+      send_error(std::string("Compute function thread exception: ") + err);
+    } catch(...) {
+      send_error("Compute function thread exception");
+    }
+  }
+}
+
+void Core::hash_rx(HashJob& job, const unsigned thread_id, const uint64_t seq) {
+  alignas(16) uint8_t  input[MAX_BLOB_LEN];
+  alignas(16) uint8_t  output[HASH_LEN];
+  alignas(16) uint64_t temp_hash[8];
+  NonceCounter::Reserve reserve;
+  bool is_first_hash = true;
+  const unsigned input_len = job.inputs[thread_id].size();
+  memcpy(input, job.inputs[thread_id].data(), input_len);
+  if (job.is_set_nonce && !job.nonces->next(job.get_nonce(input), reserve))
+    return send_nonce_exhausted(job);
+  randomx_calculate_hash_first(m_vm[thread_id], temp_hash, input, input_len);
+  while (!m_jobs->is_outdated(seq)) { // continue until we get a new job
+    uint32_t* const pnonce = job.get_nonce(input);
+    const uint32_t hash_nonce = *pnonce; // nonce of the hash returned below
+    // without next nonce the same input is hashed next only to get the last hash
+    const bool is_last = job.is_set_nonce && !job.nonces->next(pnonce, reserve);
+    randomx_calculate_hash_next(m_vm[thread_id], temp_hash, input, input_len, output);
+
+    if (!job.is_set_nonce) { // test job
+      char hash[HASH_LEN*2+1];
+      MessageValues values;
+      values["result"]       = hash_bin2hex(output, hash);
+      values["input"]        = job.input_hexes[thread_id];
+      values["rx_thread_id"] = std::to_string(thread_id);
+      values["job_id"]       = job.job_id;
+      send_msg("test", values);
+      break;
+    }
+    if (is_first_hash) { set_first_hash_timestamp(); is_first_hash = false; }
+    m_hashrate.add(thread_id);
+    if (job.target && *get_result(output) < job.target)
+      send_result(hash_nonce, output, job.job_slot, thread_id);
+    if (is_last) { send_nonce_exhausted(job); break; }
+  }
+  // only send for mine jobs
+  if (job.target) send_last_nonce(*job.get_nonce(input), job.pool_id);
+}
+
+void Core::hash_cn(HashJob& job, const unsigned thread_id, const uint64_t seq) {
+  const unsigned batch = job.batch;
+  alignas(16) uint8_t input[MAX_CPU_BATCH * MAX_BLOB_LEN];
+  alignas(16) uint8_t output[MAX_CPU_BATCH * HASH_LEN];
+  cryptonight_ctx** const ctx = m_ctx + thread_id * batch;
+  NonceCounter::Reserve reserve;
+  bool is_first_hash = true;
+  const unsigned input_len = job.inputs[0].size();
+  // batch items with new nonces (the last batch of the job can be partial, other items are hashed
+  // with their old nonces but not used)
+  unsigned nonce_num = batch;
+  for (unsigned i = 0; i != batch; ++i) {
+    memcpy(input + input_len*i, job.inputs[0].data(), input_len);
+    if (job.is_set_nonce && nonce_num == batch &&
+        !job.nonces->next(job.get_nonce(input + input_len*i), reserve)) nonce_num = i;
+  }
+  if (!nonce_num) return send_nonce_exhausted(job);
+  while (!m_jobs->is_outdated(seq)) { // continue until we get a new job
+    job.fn.cpu(input, input_len, output, ctx, job.height);
+
+    if (!job.is_set_nonce) { // test job
+      std::string result_hash_str;
+      for (unsigned i = 0; i != batch; ++ i) {
+        if (i) result_hash_str += " ";
+        char hash[HASH_LEN*2+1];
+        result_hash_str += hash_bin2hex(output, hash, i);
+      }
+      send_msg("test", "result", result_hash_str);
+      break;
+    }
+    if (is_first_hash) { set_first_hash_timestamp(); is_first_hash = false; }
+    m_hashrate.add(thread_id, nonce_num);
+
+    for (unsigned i = 0; i != nonce_num; ++i) {
+      if (job.target && *get_result(output, i) < job.target)
+        send_result(*job.get_nonce(input + input_len*i), output + HASH_LEN*i, job.job_slot, thread_id);
+    }
+    if (nonce_num != batch) { send_nonce_exhausted(job); break; } // the last partial batch
+    for (unsigned i = 0; i != batch; ++i) {
+      if (!job.nonces->next(job.get_nonce(input + input_len*i), reserve)) { nonce_num = i; break; }
+    }
+    if (!nonce_num) { send_nonce_exhausted(job); break; }
+  }
+  // only send for mine jobs
+  if (job.target) send_last_nonce(*job.get_nonce(input), job.pool_id);
+}
+
+bool Core::is_hashing() {
+  return m_jobs && m_jobs->is_active();
+}
+
+// stops hashing threads after their current hashes (they are kept for next jobs)
+void Core::stop_threads() {
+  if (m_jobs) m_jobs->stop(); // resume takes next nonces from the same m_nonces
 }
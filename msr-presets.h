@@ -0,0 +1,220 @@
+// Copyright GNU GPLv3 (c) 2023-2025 MoneroOcean <support@moneroocean.stream>
+
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include "3rdparty/fmt/core.h"
+#include "backend/cpu/Cpu.h"
+#if defined(XMRIG_FEATURE_MSR)
+#include "hw/msr/Msr.h"
+#endif
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// standard RandomX MSR presets (mostly hardware prefetcher tweaks) written to all CPUs. MSR values
+// are machine wide, so original values are saved by the first user process of the host in the
+// state file and restored after the last user of the last process is released (or at process exit
+// if some user did not release them). Processes that use presets hold a shared fcntl lock of the
+// state file users byte (it is released by the kernel if a process crashes), so the last one is
+// the process that can lock it exclusively. Original values left by a crashed last process are
+// restored by the next last one.
+class MsrPresets {
+  std::mutex m_mutex;
+  unsigned m_users;
+#if defined(XMRIG_FEATURE_MSR)
+  std::shared_ptr<xmrig::Msr> m_msr;
+  xmrig::MsrItems m_saved; // original register values (invalid items were not readable)
+
+#if defined(__linux__)
+  static constexpr const char* STATE_PATH = "/dev/shm/fast-rx-msr"; // "<reg> <value or ->" lines
+  static const off_t MUTEX_BYTE = 0; // locked while the state file is changed
+  static const off_t USERS_BYTE = 1; // locked shared by user processes
+  int m_fd = -1; // state file
+
+  // fcntl locks are per process like m_users
+  bool lock_byte(const off_t byte, const short type, const bool is_wait) {
+    struct flock fl = {};
+    fl.l_type   = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start  = byte;
+    fl.l_len    = 1;
+    while (fcntl(m_fd, is_wait ? F_SETLKW : F_SETLK, &fl) != 0) if (errno != EINTR) return false;
+    return true;
+  }
+
+  // original values of preset registers from the state file (empty if it has no valid ones)
+  xmrig::MsrItems read_state(const xmrig::MsrItems& preset) {
+    std::string data;
+    char buff[256];
+    ssize_t size;
+    while ((size = pread(m_fd, buff, sizeof(buff), data.size())) > 0) data.append(buff, size);
+    std::istringstream stream(data);
+    xmrig::MsrItems saved;
+    for (const auto& item : preset) {
+      uint32_t reg;
+      std::string value;
+      if (!(stream >> std::hex >> reg >> value) || reg != item.reg()) return xmrig::MsrItems();
+      saved.push_back(value == "-" ? xmrig::MsrItem() :
+                      xmrig::MsrItem(reg, strtoull(value.c_str(), nullptr, 16)));
+    }
+    return saved;
+  }
+
+  bool write_state(const xmrig::MsrItems& preset, const xmrig::MsrItems& saved) {
+    std::string data;
+    for (size_t i = 0; i != saved.size(); ++i)
+      data += saved[i].isValid() ? fmt::format("{:x} {:x}\n", preset[i].reg(), saved[i].value()) :
+                                   fmt::format("{:x} -\n", preset[i].reg());
+    return ftruncate(m_fd, 0) == 0 &&
+           pwrite(m_fd, data.data(), data.size(), 0) == static_cast<ssize_t>(data.size());
+  }
+#endif
+
+  xmrig::MsrItems read_items(const xmrig::MsrItems& preset) {
+    xmrig::MsrItems saved;
+    for (const auto& item : preset) saved.push_back(m_msr->read(item.reg(), -1, false));
+    return saved;
+  }
+
+  // returns original values of preset registers and makes this process a user of the state file
+  xmrig::MsrItems save_items(const xmrig::MsrItems& preset) {
+#if defined(__linux__)
+    m_fd = open(STATE_PATH, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (m_fd >= 0 && lock_byte(MUTEX_BYTE, F_WRLCK, true)) {
+      // values left by other users (or by a crashed last user) are original ones
+      xmrig::MsrItems saved = read_state(preset);
+      if (saved.empty()) {
+        saved = read_items(preset);
+        write_state(preset, saved);
+      }
+      lock_byte(USERS_BYTE, F_RDLCK, true);
+      lock_byte(MUTEX_BYTE, F_UNLCK, false);
+      return saved;
+    }
+    if (m_fd >= 0) { close(m_fd); m_fd = -1; }
+#endif
+    return read_items(preset);
+  }
+
+  static const xmrig::MsrItems& get_preset(const xmrig::ICpuInfo::MsrMod mod) {
+    static const std::array<xmrig::MsrItems, xmrig::ICpuInfo::MSR_MOD_MAX> presets = {
+      xmrig::MsrItems(),
+      xmrig::MsrItems{ // ryzen_17h
+        { 0xC0011020, 0ULL }, { 0xC0011021, 0x40ULL, ~0x20ULL },
+        { 0xC0011022, 0x1510000ULL }, { 0xC001102b, 0x2000cc16ULL }
+      },
+      xmrig::MsrItems{ // ryzen_19h
+        { 0xC0011020, 0x0004480000000000ULL }, { 0xC0011021, 0x001c000200000040ULL, ~0x20ULL },
+        { 0xC0011022, 0xc000000401570000ULL }, { 0xC001102b, 0x2000cc10ULL }
+      },
+      xmrig::MsrItems{ // ryzen_19h_zen4
+        { 0xC0011020, 0x0004400000000000ULL }, { 0xC0011021, 0x0004000000000040ULL, ~0x20ULL },
+        { 0xC0011022, 0x8680000401570000ULL }, { 0xC001102b, 0x2040cc10ULL }
+      },
+      xmrig::MsrItems{ // ryzen_1Ah_zen5
+        { 0xC0011020, 0x0004400000000000ULL }, { 0xC0011021, 0x0004000000000040ULL, ~0x20ULL },
+        { 0xC0011022, 0x8680000401570000ULL }, { 0xC001102b, 0x2040cc10ULL }
+      },
+      xmrig::MsrItems{ { 0x1a4, 0xf } }, // intel
+      xmrig::MsrItems() // custom
+    };
+    return presets[mod];
+  }
+
+  // writes item to all CPUs
+  bool write(const xmrig::MsrItem& item) {
+    return m_msr->write([&](int32_t cpu) { return m_msr->write(item, cpu, false); });
+  }
+
+  // returns "reg:ok reg:fail ..." report of the restored registers (empty string if other
+  // processes still use presets)
+  std::string restore_items() {
+    bool is_last = true;
+#if defined(__linux__)
+    if (m_fd >= 0) {
+      lock_byte(MUTEX_BYTE, F_WRLCK, true);
+      is_last = lock_byte(USERS_BYTE, F_WRLCK, false);
+    }
+#endif
+    std::string report;
+    if (is_last) for (const auto& item : m_saved) {
+      if (!item.isValid()) continue;
+      if (!report.empty()) report += " ";
+      report += fmt::format("{:#x}:{}", item.reg(), write(item) ? "ok" : "fail");
+    }
+#if defined(__linux__)
+    if (m_fd >= 0) {
+      if (is_last) write_state(xmrig::MsrItems(), xmrig::MsrItems()); // the next user saves values again
+      close(m_fd); // also unlocks its bytes
+      m_fd = -1;
+    }
+#endif
+    m_saved.clear();
+    m_msr.reset();
+    return report;
+  }
+#endif
+
+  MsrPresets() : m_users(0) {}
+  ~MsrPresets() {
+#if defined(XMRIG_FEATURE_MSR)
+    if (m_users) restore_items();
+#endif
+  }
+
+  public:
+
+  static MsrPresets& get() {
+    static MsrPresets msr_presets;
+    return msr_presets;
+  }
+
+  static const char* get_mod_name(const xmrig::ICpuInfo::MsrMod mod) {
+    static const std::array<const char*, xmrig::ICpuInfo::MSR_MOD_MAX> names = { MSR_NAMES_LIST };
+    return names[mod];
+  }
+
+  // writes preset of this CPU and returns "reg:ok reg:fail ..." report of its registers (throws
+  // error string if nothing can be written). Each successful call needs its own release call.
+  std::string apply() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+#if defined(XMRIG_FEATURE_MSR)
+    const xmrig::MsrItems& preset = get_preset(xmrig::Cpu::info()->msrMod());
+    if (preset.empty()) throw std::string("No MSR preset for this CPU");
+    if (!m_users) {
+      m_msr = xmrig::Msr::get();
+      if (!m_msr) throw std::string("MSR kernel module is not available (root access is required)");
+      m_saved = save_items(preset);
+    }
+    ++ m_users;
+    std::string report;
+    for (size_t i = 0; i != preset.size(); ++i) {
+      if (!report.empty()) report += " ";
+      // registers that can not be restored are not written
+      report += fmt::format("{:#x}:{}", preset[i].reg(),
+                            m_saved[i].isValid() && write(preset[i]) ? "ok" : "fail");
+    }
+    return report;
+#else
+    throw std::string("MSR registers are not supported on this platform");
+#endif
+  }
+
+  // returns report of restored registers if this was the last user of the host (empty string
+  // otherwise)
+  std::string release() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_users || -- m_users) return std::string();
+#if defined(XMRIG_FEATURE_MSR)
+    return restore_items();
+#else
+    return std::string();
+#endif
+  }
+};
@@ -0,0 +1,76 @@
+// Copyright GNU GPLv3 (c) 2023-2025 MoneroOcean <support@moneroocean.stream>
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// nonces of one job that hashing threads reserve in blocks from a shared atomic counter (like
+// xmrig::Nonce::next with its reserveCount and mask, but per job instead of process wide). Block b
+// of the nonce range belongs to cores with thread_id b % thread_num (they can be in other processes)
+// so any number of hashing threads can take nonces without overlaps. Nonce bits out of mask (nicehash
+// byte) are kept from the input.
+class NonceCounter {
+  static const uint32_t BLOCK_SIZE = 256; // nonces reserved at once
+
+  std::atomic<uint64_t> m_block; // next block of this core (among its thread_id blocks)
+  std::atomic<bool> m_is_exhausted;
+  const uint64_t m_start, m_mask;
+  const unsigned m_thread_id, m_thread_num;
+
+  public:
+
+  // nonces left in the last block reserved by one hashing thread
+  struct Reserve {
+    uint64_t nonce = 0;
+    uint32_t left  = 0;
+  };
+
+  NonceCounter(
+    const uint32_t start, const uint32_t mask, const unsigned thread_id, const unsigned thread_num
+  ) : m_block(0), m_is_exhausted(false), m_start(start & mask), m_mask(mask),
+      m_thread_id(thread_id), m_thread_num(thread_num) {}
+
+  // counter of cores of this process that hash the same job with the same thread_id (so they split
+  // its nonces), key identifies this job
+  static std::shared_ptr<NonceCounter> get(
+    const std::string& key, const uint32_t start, const uint32_t mask,
+    const unsigned thread_id, const unsigned thread_num
+  ) {
+    static std::mutex mutex;
+    static std::map<std::string, std::weak_ptr<NonceCounter> > counters;
+    const std::string key2 = key + " " + std::to_string(start) + " " + std::to_string(mask) + " " +
+                             std::to_string(thread_id) + "/" + std::to_string(thread_num);
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto pi = counters.begin(); pi != counters.end();)
+      if (pi->second.expired()) pi = counters.erase(pi); else ++ pi;
+    std::weak_ptr<NonceCounter>& counter = counters[key2];
+    std::shared_ptr<NonceCounter> result = counter.lock();
+    if (!result) counter = result = std::make_shared<NonceCounter>(start, mask, thread_id, thread_num);
+    return result;
+  }
+
+  // writes the next nonce of reserve to *nonce (reserves new block if needed), returns false if
+  // nonces of this job are exhausted
+  bool next(uint32_t* const nonce, Reserve& reserve) {
+    if (!reserve.left) {
+      const uint64_t block = m_block.fetch_add(1, std::memory_order_relaxed) * m_thread_num + m_thread_id;
+      const uint64_t first = m_start + block * BLOCK_SIZE;
+      if (first > m_mask) return false;
+      reserve.nonce = first;
+      reserve.left  = std::min<uint64_t>(BLOCK_SIZE, m_mask - first + 1);
+    }
+    *nonce = static_cast<uint32_t>((*nonce & ~m_mask) | reserve.nonce);
+    ++ reserve.nonce;
+    -- reserve.left;
+    return true;
+  }
+
+  // returns true only for the first caller (so exhaustion is reported once)
+  inline bool set_exhausted() { return !m_is_exhausted.exchange(true); }
+};
@@ -0,0 +1,126 @@
+// Copyright GNU GPLv3 (c) 2023-2025 MoneroOcean <support@moneroocean.stream>
+
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__linux__)
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// NUMA nodes with CPUs read from /sys/devices/system/node (without hwloc or libnuma), there is
+// only one node on other platforms or if this topology is not available
+class NumaNodes {
+  std::vector<unsigned> m_ids;                // kernel ids of nodes
+  std::vector<std::vector<unsigned> > m_cpus; // CPUs of nodes
+  std::vector<unsigned> m_cpu2node;           // node index of CPUs
+
+  static const unsigned MASK_BITS = 8 * sizeof(unsigned long);
+  static const unsigned MASK_SIZE = 1024 / MASK_BITS; // node mask words for up to 1024 node ids
+
+  bool get_mask(const unsigned node, unsigned long* const mask) const {
+    const unsigned id = m_ids[node];
+    if (id >= MASK_SIZE * MASK_BITS) return false;
+    mask[id / MASK_BITS] |= 1UL << (id % MASK_BITS);
+    return true;
+  }
+
+  public:
+
+  // parses "0-3,8-11" style CPU list (throws std::out_of_range for a reversed range or a CPU that is
+  // not below cpu_num)
+  static std::vector<unsigned> parse_cpu_list(const std::string& str, const unsigned cpu_num = UINT_MAX) {
+    std::vector<unsigned> cpus;
+    std::istringstream stream(str);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+      if (range.empty() || !isdigit(range[0])) continue;
+      const size_t dash = range.find('-');
+      const unsigned long first = std::stoul(range),
+                          last  = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+      if (last < first || last >= cpu_num) throw std::out_of_range("Bad CPU range");
+      for (unsigned cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+    }
+    return cpus;
+  }
+
+  NumaNodes() {
+    const unsigned cpu_num = std::max(std::thread::hardware_concurrency(), 1u);
+    m_cpu2node.assign(cpu_num, 0);
+#if defined(__linux__)
+    std::vector<unsigned> ids;
+    if (DIR* const dir = opendir("/sys/devices/system/node")) {
+      while (const dirent* const entry = readdir(dir)) {
+        const std::string name = entry->d_name;
+        if (name.size() > 4 && name.starts_with("node") && isdigit(name[4])) ids.push_back(std::stoul(name.substr(4)));
+      }
+      closedir(dir);
+    }
+    std::sort(ids.begin(), ids.end());
+    for (const unsigned id : ids) {
+      std::ifstream file("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+      std::string cpu_list;
+      std::getline(file, cpu_list);
+      std::vector<unsigned> cpus = parse_cpu_list(cpu_list);
+      if (cpus.empty()) continue; // memory only node
+      for (const unsigned cpu : cpus) if (cpu < cpu_num) m_cpu2node[cpu] = m_ids.size();
+      m_ids.push_back(id);
+      m_cpus.push_back(std::move(cpus));
+    }
+#endif
+    if (m_ids.empty()) {
+      m_ids.push_back(0);
+      m_cpus.emplace_back();
+      for (unsigned cpu = 0; cpu != cpu_num; ++cpu) m_cpus.back().push_back(cpu);
+    }
+  }
+
+  inline unsigned size() const { return m_ids.size(); }
+  inline const std::vector<unsigned>& cpus(const unsigned node) const { return m_cpus[node]; }
+  // node of the CPU used by pin_thread(cpu)
+  inline unsigned cpu_node(const unsigned cpu) const { return m_cpu2node[cpu % m_cpu2node.size()]; }
+
+  // binds memory range to the node (moves its already allocated pages there if possible)
+  bool bind(void* const mem, const size_t mem_size, const unsigned node) const {
+#if defined(__linux__)
+    unsigned long mask[MASK_SIZE] = {};
+    if (size() < 2 || !get_mask(node, mask)) return false;
+    return syscall(SYS_mbind, mem, mem_size, MPOL_PREFERRED, mask, MASK_SIZE * MASK_BITS + 1, MPOL_MF_MOVE) == 0;
+#else
+    return false;
+#endif
+  }
+
+  // memory allocated (first touched) by the calling thread while it is in scope is placed on the
+  // node if it has free memory there
+  class MemoryPolicy {
+    bool m_is_set;
+
+    public:
+
+    MemoryPolicy(const NumaNodes& nodes, const unsigned node, const bool is_enabled = true)
+      : m_is_set(false) {
+#if defined(__linux__)
+      unsigned long mask[MASK_SIZE] = {};
+      if (!is_enabled || nodes.size() < 2 || !nodes.get_mask(node, mask)) return;
+      m_is_set = syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, MASK_SIZE * MASK_BITS + 1) == 0;
+#endif
+    }
+    ~MemoryPolicy() {
+#if defined(__linux__)
+      if (m_is_set) syscall(SYS_set_mempolicy, MPOL_DEFAULT, nullptr, 0);
+#endif
+    }
+  };
+};
@@ -0,0 +1,157 @@
+// Copyright GNU GPLv3 (c) 2023-2025 MoneroOcean <support@moneroocean.stream>
+
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "base/tools/Chrono.h"
+#if defined(__linux__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// named memory shared by processes of the host: the first process fills it and others only map
+// it read-only, the last process that releases it removes it with its lock file. Users hold shared
+// flock on it, so memory left by crashed processes (of any name) is removed by the next process
+// that maps shared memory. If no process of the host maps it again, the leftover memory has to be
+// removed by hand: rm /dev/shm/fast-rx-* /dev/hugepages/fast-rx-*
+class SharedMemory {
+  static constexpr const char* PREFIX = "fast-rx-"; // of memory file names
+  static const size_t   HEADER_SIZE = 2*1024*1024; // after data to keep its huge page alignment
+  static const uint64_t MAGIC       = 0x5852545341465846ULL; // marks filled memory
+
+  struct Header {
+    uint64_t magic;
+    uint64_t init_time; // ms
+  };
+
+  std::string m_path;
+  int         m_fd;
+  uint8_t*    m_mem;
+  size_t      m_size;
+  bool        m_is_huge_pages;
+
+#if defined(__linux__)
+  // locks creation and removal of the memory under path (its lock file is locked again if it was
+  // removed by the previous lock owner before it was locked here)
+  class Lock {
+    const std::string m_path;
+    int m_fd;
+    public:
+    Lock(const std::string& path, const bool is_try = false) : m_path(path + ".lock"), m_fd(-1) {
+      while (true) {
+        const int fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd < 0) return;
+        struct stat st, st2;
+        if (flock(fd, is_try ? LOCK_EX | LOCK_NB : LOCK_EX) != 0) { close(fd); return; }
+        if (fstat(fd, &st) == 0 && stat(m_path.c_str(), &st2) == 0 &&
+            st.st_dev == st2.st_dev && st.st_ino == st2.st_ino) { m_fd = fd; return; }
+        close(fd);
+      }
+    }
+    ~Lock() { if (m_fd >= 0) close(m_fd); }
+    bool is_locked() const { return m_fd >= 0; }
+    void remove() const { unlink(m_path.c_str()); } // memory under lock should be removed before
+  };
+
+  // removes memory (and lock files) in dir without users except memory under except_path
+  static void remove_unused(const std::string& dir, const std::string& except_path) {
+    DIR* const d = opendir(dir.c_str());
+    if (d == nullptr) return;
+    std::vector<std::string> paths; // each memory file has a lock file (it is created first)
+    while (const dirent* const entry = readdir(d)) {
+      const std::string name = entry->d_name;
+      if (name.starts_with(PREFIX) && name.ends_with(".lock"))
+        paths.push_back(dir + "/" + name.substr(0, name.size() - 5));
+    }
+    closedir(d);
+    for (const auto& path : paths) {
+      if (path == except_path) continue;
+      const Lock lock(path, true); // memory that is filled now is locked
+      if (!lock.is_locked()) continue;
+      const int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+      if (fd < 0 && errno != ENOENT) continue;
+      if (fd >= 0) {
+        const bool is_unused = flock(fd, LOCK_EX | LOCK_NB) == 0;
+        if (is_unused) unlink(path.c_str());
+        close(fd);
+        if (!is_unused) continue;
+      }
+      lock.remove();
+    }
+  }
+
+  bool map(const std::string& path, const size_t size, const std::function<void(uint8_t*)>& fn_init) {
+    remove_unused(path.substr(0, path.rfind('/')), path);
+    const Lock lock(path);
+    if (!lock.is_locked()) return false;
+    const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return false;
+    flock(fd, LOCK_SH);
+    struct stat st;
+    void* mem = MAP_FAILED;
+    // fallocate (unlike ftruncate) fails if there is not enough memory in the file system
+    if (fstat(fd, &st) == 0 && (
+          static_cast<size_t>(st.st_size) == size + HEADER_SIZE || fallocate(fd, 0, 0, size + HEADER_SIZE) == 0
+        )
+    ) mem = mmap(nullptr, size + HEADER_SIZE, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (mem == MAP_FAILED) {
+      if (flock(fd, LOCK_EX | LOCK_NB) == 0) { unlink(path.c_str()); lock.remove(); }
+      close(fd);
+      return false;
+    }
+    const Header* const header = reinterpret_cast<const Header*>(static_cast<uint8_t*>(mem) + size);
+    if (header->magic != MAGIC) { // fill memory (again if its previous filling was interrupted)
+      mprotect(mem, size + HEADER_SIZE, PROT_READ | PROT_WRITE);
+      const uint64_t init_timestamp = xmrig::Chrono::steadyMSecs();
+      fn_init(static_cast<uint8_t*>(mem));
+      Header* const header2 = const_cast<Header*>(header);
+      header2->init_time = xmrig::Chrono::steadyMSecs() - init_timestamp;
+      header2->magic     = MAGIC;
+      mprotect(mem, size + HEADER_SIZE, PROT_READ);
+    }
+    m_path = path;
+    m_fd   = fd;
+    m_mem  = static_cast<uint8_t*>(mem);
+    return true;
+  }
+#endif
+
+  public:
+
+  SharedMemory(const std::string& name, const size_t size, const std::function<void(uint8_t*)>& fn_init)
+    : m_fd(-1), m_mem(nullptr), m_size(size), m_is_huge_pages(false)
+  {
+#if defined(__linux__)
+    // hugetlbfs memory is used if it is mounted and has enough free huge pages
+    const std::string file_name = PREFIX + name;
+    if (map("/dev/hugepages/" + file_name, size, fn_init)) { m_is_huge_pages = true; return; }
+    if (map("/dev/shm/" + file_name, size, fn_init)) return;
+#endif
+    throw std::string("Can't map " + std::to_string(size) + " bytes of shared memory");
+  }
+
+  ~SharedMemory() {
+#if defined(__linux__)
+    const Lock lock(m_path);
+    munmap(m_mem, m_size + HEADER_SIZE);
+    // exclusive lock is only possible if there are no other users
+    if (flock(m_fd, LOCK_EX | LOCK_NB) == 0) { unlink(m_path.c_str()); lock.remove(); }
+    close(m_fd);
+#endif
+  }
+
+  inline uint8_t* raw() const { return m_mem; } // mapped read-only
+  inline bool is_huge_pages() const { return m_is_huge_pages; }
+  // time it took to fill memory by its first process (ms)
+  inline uint64_t init_time() const {
+    return reinterpret_cast<const Header*>(m_mem + m_size)->init_time;
+  }
+};
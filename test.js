@@ -10,7 +10,8 @@ if (fast_rx.cluster_process()) return;
 
 let args = process.argv.slice(2);
 const job          = JSON.parse(args.shift());
-const result_hexes = args;
+let   result_hexes = args;
+const nonce_pos    = (job.algo === "ghostrider" ? 76 : 39)*2; // nonce position in blob_hex
 
 function exit(code) {
   fast_rx.messageWorkers({type: "close"});
@@ -18,9 +19,184 @@ function exit(code) {
   return false;
 }
 
+// little-endian uint64 of hex string bytes
+function le64(hex) {
+  return BigInt("0x" + (hex.match(/../g) || []).reverse().join(""));
+}
+
+// 64-bit share target of job.target (8 or 16 hex chars) or job.difficulty like Core::get_target
+function get_target() {
+  if (job.target) return job.target.length === 8 ?
+    0xFFFFFFFFFFFFFFFFn / (0xFFFFFFFFn / le64(job.target)) : le64(job.target);
+  return 0xFFFFFFFFFFFFFFFFn / BigInt(job.difficulty);
+}
+
+// cores of this process hash test jobs of job.algo and job.concurrent_algo at the same time (each
+// core repeats its test job several times and gets one of result_hexes)
+if (job.concurrent_algo) {
+  const CONCURRENT_ROUNDS = 4;
+  const algos = [job.algo, job.concurrent_algo];
+  let done_count = 0;
+  const cores = algos.map(function(algo, i) {
+    const core = fast_rx.create_core();
+    let round = 0;
+    core.from.on("test", function(v) {
+      if (v.result !== result_hexes[i]) {
+        console.error("FAILED: " + algo + " " + v.result + " != " + result_hexes[i]);
+        return close(1);
+      }
+      if (++ round < CONCURRENT_ROUNDS) return core.emit_to("test", Object.assign({}, job, {algo: algo}));
+      if (++ done_count === cores.length) {
+        console.log("PASSED");
+        return close(0);
+      }
+    });
+    core.from.on("error", function(v) {
+      console.error("Compute core error: " + JSON.stringify(v));
+      return close(1);
+    });
+    return core;
+  });
+  function close(code) {
+    for (const core of cores) core.emit_to("close");
+    process.exitCode = code;
+    return false;
+  }
+  cores.forEach(function(core, i) { core.emit_to("test", Object.assign({}, job, {algo: algos[i]})); });
+  return;
+}
+
 // handles messages sent to the master thread from worker threads
 function messageHandler(msg) {
   switch (msg.type) {
+    case "result": // verify first mined share by computing its blob hash in test mode
+      if ("dataset_loaded" in job && job.is_dataset_loaded !== job.dataset_loaded) {
+        console.error("FAILED: dataset is_loaded " + job.is_dataset_loaded + " != " + job.dataset_loaded);
+        return exit(1);
+      }
+      if (!(le64(msg.value.hash.substr(48, 16)) < get_target())) { // top 64 bits of share hash
+        console.error("FAILED: share hash " + msg.value.hash + " is over target");
+        return exit(1);
+      }
+      if (job.exhaust_test) return; // waits for nonce_exhausted
+      if (job.switch_seed_hex) { // old seed job should be mined while new seed dataset is prepared
+        if (!job.is_switched) {
+          job.is_switched = true;
+          job.old_results = 0;
+          job.seed_hex    = job.switch_seed_hex;
+          job.job_id      = "switched";
+          job.blob_hex    = "00" + job.blob_hex.substr(2); // not a duplicate job
+          fast_rx.messageWorkers({type: "job", job: job});
+          return;
+        }
+        if (msg.value.job_id !== job.job_id) { ++ job.old_results; return; }
+        if (!job.old_results) {
+          console.error("FAILED: no old job shares while new seed dataset was prepared");
+          return exit(1);
+        }
+      }
+      if (job.resize_dev && job.dev !== job.resize_dev) { // hashing continues with other threads
+        job.dev      = job.resize_dev;
+        job.job_id   = "resized";
+        job.blob_hex = "00" + job.blob_hex.substr(2); // not a duplicate job
+        fast_rx.messageWorkers({type: "job", job: job});
+        return;
+      }
+      if ("job_id" in job && msg.value.job_id !== job.job_id) {
+        console.error("FAILED: share job_id " + msg.value.job_id + " != " + job.job_id);
+        return exit(1);
+      }
+      if (job.pause_test && !job.is_resumed) { // first pause and resume mining if requested
+        if (job.is_paused) return;
+        job.is_paused = true;
+        fast_rx.messageWorkers({type: "pause"});
+        setTimeout(function() {
+          job.is_resumed = true;
+          fast_rx.messageWorkers({type: "resume"});
+        }, 500);
+        return;
+      }
+      if (job.stats_test) { // request hashrate stats after some samples are taken
+        if (job.is_stats_sent) return;
+        job.is_stats_sent = true;
+        setTimeout(function() { fast_rx.messageWorkers({type: "stats"}); }, 3000);
+        return;
+      }
+      if (job.is_verify_sent) return;
+      job.is_verify_sent = true;
+      // rx threads of the verify job hash the same blob
+      result_hexes = Array(fast_rx.get_dev_batch(fast_rx.get_thread_dev(msg.thread_id, job.dev))).
+                     fill(msg.value.hash);
+      job.blob_hex = job.blob_hex.substr(0, nonce_pos) + msg.value.nonce +
+                     job.blob_hex.substr(nonce_pos + msg.value.nonce.length);
+      fast_rx.messageWorkers({type: "test", job: job});
+      return;
+
+    case "hashrate": case "last_nonce": return;
+
+    case "nonce_exhausted":
+      if (!job.exhaust_test || msg.value.job_id !== job.job_id) {
+        console.error("FAILED: nonce_exhausted " + JSON.stringify(msg.value));
+        return exit(1);
+      }
+      console.log("PASSED: " + JSON.stringify(msg.value));
+      return exit(0);
+
+    case "dataset_progress":
+      if (!(parseInt(msg.value.progress) >= 0 && parseInt(msg.value.progress) <= 100)) {
+        console.error("FAILED: dataset_progress " + JSON.stringify(msg.value));
+        return exit(1);
+      }
+      job.is_dataset_loaded = parseInt(msg.value.is_loaded);
+      return;
+
+    case "rx_tune":
+      if (!(parseInt(msg.value.prefetch_mode) >= 0 && parseInt(msg.value.prefetch_mode) <= 3) ||
+          !(parseInt(msg.value.dataset_init) >= 0 && parseInt(msg.value.dataset_init) <= 2) ||
+          !(parseInt(msg.value.aes_impl) >= 0 && parseInt(msg.value.aes_impl) <= 2)) {
+        console.error("FAILED: rx_tune " + JSON.stringify(msg.value));
+        return exit(1);
+      }
+      console.log("rx_tune: " + JSON.stringify(msg.value));
+      return;
+
+    case "msr": // MSR registers are not writable without root and msr kernel module
+      if (!msg.value.msr_mod || (!msg.value.registers && !msg.value.error)) {
+        console.error("FAILED: msr " + JSON.stringify(msg.value));
+        return exit(1);
+      }
+      console.log("msr: " + JSON.stringify(msg.value));
+      return;
+
+    case "bench":
+      if (!(parseFloat(msg.value.hashrate) > 0)) {
+        console.error("FAILED: bench " + JSON.stringify(msg.value));
+        return exit(1);
+      }
+      console.log("PASSED: " + JSON.stringify(msg.value));
+      return exit(0);
+
+    case "stats": {
+      const is_rx = job.algo.includes("rx/");
+      const thread_num = is_rx ? fast_rx.get_dev_batch(fast_rx.get_thread_dev(msg.thread_id, job.dev)) :
+                         job.threads || 1;
+      if (msg.value.threads_10s.split(" ").length !== thread_num ||
+          !(parseFloat(msg.value.total_10s) > 0) || !(parseInt(msg.value.hashes) > 0)) {
+        console.error("FAILED: stats " + JSON.stringify(msg.value));
+        return exit(1);
+      }
+      console.log("PASSED: " + JSON.stringify(msg.value));
+      return exit(0);
+    }
+
+    case "verify": // all verified blob hashes are in one reply
+      if (msg.value.result !== result_hexes.join(" ")) {
+        console.error("FAILED: " + msg.value.result + " != " + result_hexes.join(" "));
+        return exit(1);
+      }
+      console.log("PASSED");
+      return exit(0);
+
     case "test":
       const is_rx = job.algo.includes("rx/");
       // duplicate test result for batch size
@@ -47,4 +223,9 @@ function messageHandler(msg) {
   }
 }
 fast_rx.create_thread(messageHandler);
-fast_rx.messageWorkers({type: "test", job: job});
+// jobs with target or difficulty are mined first and then their share is verified in test mode
+fast_rx.messageWorkers({
+  type: "bench_time" in job ? "bench" : "target" in job || "difficulty" in job ? "job" :
+        "verify" in job ? "verify" : "test",
+  job:  job
+});
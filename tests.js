@@ -3,6 +3,13 @@
 "use strict";
 
 const child_process = require("child_process");
+const fs   = require("fs");
+const os   = require("os");
+const path = require("path");
+
+// rx dataset files and rx tune files (it is also temp dir of tests) of tests are saved here, it is
+// removed after tests
+const dataset_dir = fs.mkdtempSync(path.join(os.tmpdir(), "fast-rx-test-"));
 
 function test(job, result, cb) {
   if (!("dev" in job))      job.dev      = "cpu";
@@ -26,7 +33,7 @@ function test(job, result, cb) {
     return fail("Timeouted");
   }, 5*60*1000);
 
-  test_process = child_process.exec(cmd);
+  test_process = child_process.exec(cmd, { env: Object.assign({}, process.env, { TMPDIR: dataset_dir }) });
   test_process.stdout.on('data', function(data) { output += data; });
   test_process.stderr.on('data', function(data) { output += data; });
   test_process.on('exit', function(code) {
@@ -119,6 +126,53 @@ let tests = [
     "5ac3f785c490c58550ec95d2726563577e7c1c212d0cde591273201e44fdd5b6"
   ], [ test, { algo: "cn-heavy/tube" },
     "fe53352076eae689fa3b4fda614634cfc312ee0c387df2b8b74da2a159741235"
+  ], [ test, { algo: "rx/0", target: "ffffff00", nonce: 1000 }, []
+  ], [ test, { algo: "rx/0", dev: "cpu*2", target: "ffffff00", pause_test: 1 }, []
+  ], [ test, { algo: "cn/r", height: 1806260, difficulty: 2, job_id: "cn-r-job" }, []
+  ], [ test, { algo: "cn/2", dev: "cpu*2", difficulty: 4, pause_test: 1 }, []
+  ], [ test, { algo: "rx/0", dev: "cpu*2", bench_time: 3 }, []
+  ], [ test, { algo: "rx/0", dev: "cpu*2", bench_time: 3, one_gb_pages: 2, msr: 1 }, []
+  ], [ test, { algo: "cn/2", bench_time: 3 }, []
+  ], [ test, { algo: "rx/0", dev: "cpu*2", difficulty: 1, stats_test: 1 }, []
+  ], [ test, { algo: "cn/2", difficulty: 1, stats_test: 1 }, []
+  ], [ test, { algo: "cn/2", dev: "cpu*2", threads: 2, difficulty: 4, pause_test: 1 }, []
+  ], [ test, { algo: "cn/2", dev: "cpu*2@0:0", threads: 2, bench_time: 3 }, []
+  ], [ test, { algo: "cn/2", dev: "cpu*2", threads: 2, difficulty: 4, is_nicehash: 1, nonce: 16776960,
+            job_id: "exhausted", exhaust_test: 1 }, []
+  ], [ test, { algo: "argon2/chukwav2", threads: 3, difficulty: 1, stats_test: 1 }, []
+  ], [ test, { algo: "rx/0", dev: "cpu*2", difficulty: 16,
+            switch_seed_hex: "0000000000000000000000000000000000000000000000000000000000000001" }, []
+  ], [ test, { algo: "rx/0", dev: "cpu*2", difficulty: 16,
+            next_seed_hex:   "0000000000000000000000000000000000000000000000000000000000000002",
+            switch_seed_hex: "0000000000000000000000000000000000000000000000000000000000000002" }, []
+  ], [ test, { algo: "rx/0", dev: "cpu*2", target: "ffffff00", shared_dataset: 1 }, []
+  ], [ test, { algo: "rx/0", dev: "cpu-light*2", target: "ffffff00" }, []
+  ], [ test, { algo: "rx/0", dev: "cpu-light*2", difficulty: 16, resize_dev: "cpu-light*3" }, []
+  ], [ test, { algo: "rx/0", dev: "cpu*2", target: "ffffff00", dataset_dir: dataset_dir,
+               dataset_loaded: 0 }, [] // saves
+  ], [ test, { algo: "rx/0", dev: "cpu*2", target: "ffffff00", dataset_dir: dataset_dir,
+               dataset_loaded: 1 }, [] // loads
+  ], [ test, { algo: "rx/0", dev: "cpu", verify: 1, blob_hex: "5468697320697320612074657374\n00" },
+    [ "38f638606c730dd6f271d037556b83988c71acc6980e22e25271b22389ecfce6",
+      "f4d7978d385b7d79788aed32cf9e08d2782bc3c47ab50cae69c0dfba3a3bd1d7"
+    ]
+  ], [ test, { algo: "rx/wow", dev: "cpu-light", verify: 1,
+            blob_hex: "5468697320697320612074657374\n5468697320697320612074657374",
+            seed_hex: "3132333435363738393031323334353637383930313233343536373839303132\n" +
+                      "0000000000000000000000000000000000000000000000000000000000000001" },
+    [ "15c9bd99b3180ab256e89beecaf7b693abb7cdb0d1dfe30020c72f0c70b904ce",
+      "7f7d2ec8dd966f1bacdb19f450255a46eef353d917758f775559df6f6431ce33"
+    ]
+  ], [ test, { algo: "rx/0", dev: "cpu-light", concurrent_algo: "rx/wow",
+               blob_hex: "5468697320697320612074657374" },
+    [ "38f638606c730dd6f271d037556b83988c71acc6980e22e25271b22389ecfce6",
+      "15c9bd99b3180ab256e89beecaf7b693abb7cdb0d1dfe30020c72f0c70b904ce"
+    ]
+  ], [ test, { algo: "ghostrider", dev: "cpu*8", threads: 2, difficulty: 1,
+            blob_hex: "000000208c246d0b90c3b389c4086e8b672ee040" +
+                      "d64db5b9648527133e217fbfa48da64c0f3c0a0b" +
+                      "0e8350800568b40fbb323ac3ccdf2965de51b9aa" +
+                      "eb939b4f11ff81c49b74a16156ff251c00000000" }, []
   ],
 ];
 
@@ -143,6 +197,7 @@ repeat(function(cb_next) {
       return cb_next();
     });
   } else {
+    fs.rmSync(dataset_dir, { recursive: true, force: true });
     console.log(fail_count ? "FAILED (" + fail_count + " of " + test_count + " tests)" :
                              "PASSED (" + test_count + " tests)");
     process.exit(fail_count ? 1 : 0);
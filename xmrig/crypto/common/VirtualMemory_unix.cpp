@@ -96,7 +96,7 @@ bool xmrig::VirtualMemory::isHugepagesAvailable()
 
 bool xmrig::VirtualMemory::isOneGbPagesAvailable()
 {
-#   ifdef XMRIG_OS_LINUX
+#   if defined(XMRIG_OS_LINUX) || defined(__linux__)
     return Cpu::info()->hasOneGbPages();
 #   else
     return false;
@@ -191,7 +191,7 @@ void *xmrig::VirtualMemory::allocateLargePagesMemory(size_t size)
 
 void *xmrig::VirtualMemory::allocateOneGbPagesMemory(size_t size)
 {
-#   ifdef XMRIG_OS_LINUX
+#   if defined(XMRIG_OS_LINUX) || defined(__linux__)
     if (isOneGbPagesAvailable()) {
         void *mem = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE | hugePagesFlag(kOneGiB), 0, 0);
 
@@ -279,5 +279,6 @@ void xmrig::VirtualMemory::freeLargePagesMemory()
         munlock(m_scratchpad, m_size);
     }
 
-    freeLargePagesMemory(m_scratchpad, m_size);
+    // 1 GB page mapping can only be unmapped by whole pages
+    freeLargePagesMemory(m_scratchpad, isOneGbPages() ? m_capacity : m_size);
 }
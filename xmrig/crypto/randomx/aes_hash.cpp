@@ -29,8 +29,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <thread>
 #include <vector>
 #include <array>
+#include <atomic>
 
 #include "crypto/randomx/aes_hash.hpp"
+#include "backend/cpu/Cpu.h"
 #include "base/tools/Chrono.h"
 #include "crypto/randomx/randomx.h"
 #include "crypto/randomx/soft_aes.h"
@@ -46,6 +48,201 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define AES_HASH_1R_XKEY0 0x06890201, 0x90dc56bf, 0x8b24949f, 0xf6fa8389
 #define AES_HASH_1R_XKEY1 0xed18f99b, 0xee1043c6, 0x51f4e03c, 0x61b263d1
 
+#define AES_GEN_1R_KEY0 0xb4f44917, 0xdbb5552b, 0x62716609, 0x6daca553
+#define AES_GEN_1R_KEY1 0x0da1dc4e, 0x1725d378, 0x846a710d, 0x6d7caf07
+#define AES_GEN_1R_KEY2 0x3e20e345, 0xf4c0794f, 0x9f947ec6, 0x3f1262f1
+#define AES_GEN_1R_KEY3 0x49169154, 0x16314c88, 0xb1ba317c, 0x6aef8135
+
+// hard AES implementation selected by SelectHardAESImpl (0 is AES-NI), it is read for each call
+static std::atomic<int> hardAESImpl{0};
+
+#if defined(HAVE_VAES)
+/*
+	VAES variants of hard AES functions below. AES lanes alternate between
+	aesenc and aesdec, so 256-bit vectors keep lanes of the same kind together
+	([0, 2] and [1, 3]) and they are shuffled to memory order on loads and
+	stores. 512-bit hashAndFillAes1Rx4 also packs hash and fill lanes of the
+	same kind in one vector (so each 64-byte block needs two AES instructions).
+*/
+
+// two extra rounds of hashAes1Rx4 and hashAndFillAes1Rx4 (in memory lane order)
+static FORCE_INLINE void hashAes1Rx4Final(__m256i state02, __m256i state13, void *hash) {
+	const __m256i xkey0 = _mm256_broadcastsi128_si256(rx_set_int_vec_i128(AES_HASH_1R_XKEY0));
+	const __m256i xkey1 = _mm256_broadcastsi128_si256(rx_set_int_vec_i128(AES_HASH_1R_XKEY1));
+
+	state02 = _mm256_aesenc_epi128(state02, xkey0);
+	state13 = _mm256_aesdec_epi128(state13, xkey0);
+
+	state02 = _mm256_aesenc_epi128(state02, xkey1);
+	state13 = _mm256_aesdec_epi128(state13, xkey1);
+
+	_mm256_storeu_si256((__m256i*)hash + 0, _mm256_permute2x128_si256(state02, state13, 0x20));
+	_mm256_storeu_si256((__m256i*)hash + 1, _mm256_permute2x128_si256(state02, state13, 0x31));
+}
+
+static void hashAes1Rx4_VAES256(const void *input, size_t inputSize, void *hash) {
+	const uint8_t* inptr = (uint8_t*)input;
+	const uint8_t* inputEnd = inptr + inputSize;
+
+	__m256i state02 = _mm256_set_epi32(AES_HASH_1R_STATE2, AES_HASH_1R_STATE0);
+	__m256i state13 = _mm256_set_epi32(AES_HASH_1R_STATE3, AES_HASH_1R_STATE1);
+
+	while (inptr < inputEnd) {
+		const __m256i in01 = _mm256_load_si256((const __m256i*)inptr + 0);
+		const __m256i in23 = _mm256_load_si256((const __m256i*)inptr + 1);
+
+		state02 = _mm256_aesenc_epi128(state02, _mm256_permute2x128_si256(in01, in23, 0x20));
+		state13 = _mm256_aesdec_epi128(state13, _mm256_permute2x128_si256(in01, in23, 0x31));
+
+		inptr += 64;
+	}
+
+	hashAes1Rx4Final(state02, state13, hash);
+}
+
+static void fillAes4Rx4_VAES256(void *state, size_t outputSize, void *buffer) {
+	const uint8_t* outptr = (uint8_t*)buffer;
+	const uint8_t* outputEnd = outptr + outputSize;
+
+	// lanes 0 and 2 use keys 0-3 and 4-7
+	__m256i keys[4];
+	for (int i = 0; i < 4; ++i) {
+		keys[i] = _mm256_setr_m128i(RandomX_CurrentConfig.fillAes4Rx4_Key[i], RandomX_CurrentConfig.fillAes4Rx4_Key[i + 4]);
+	}
+
+	const __m256i state01 = _mm256_loadu_si256((const __m256i*)state + 0);
+	const __m256i state23 = _mm256_loadu_si256((const __m256i*)state + 1);
+	__m256i state02 = _mm256_permute2x128_si256(state01, state23, 0x20);
+	__m256i state13 = _mm256_permute2x128_si256(state01, state23, 0x31);
+
+#define TRANSFORM_VAES256 do { \
+	for (int i = 0; i < 4; ++i) { \
+		state02 = _mm256_aesdec_epi128(state02, keys[i]); \
+		state13 = _mm256_aesenc_epi128(state13, keys[i]); \
+	} \
+} while (0)
+
+	for (int i = 0; i < 2; ++i, outptr += 64) {
+		TRANSFORM_VAES256;
+		_mm256_storeu_si256((__m256i*)outptr + 0, _mm256_permute2x128_si256(state02, state13, 0x20));
+		_mm256_storeu_si256((__m256i*)outptr + 1, _mm256_permute2x128_si256(state02, state13, 0x31));
+	}
+
+	static constexpr randomx::Instruction inst{ 0xFF, 7, 7, 0xFF, 0xFFFFFFFFU };
+	alignas(32) static const randomx::Instruction inst_mask[4] = { inst, inst, inst, inst };
+	const __m256i mask = _mm256_load_si256((const __m256i*)inst_mask);
+
+	while (outptr < outputEnd) {
+		TRANSFORM_VAES256;
+		_mm256_storeu_si256((__m256i*)outptr + 0, _mm256_and_si256(_mm256_permute2x128_si256(state02, state13, 0x20), mask));
+		_mm256_storeu_si256((__m256i*)outptr + 1, _mm256_and_si256(_mm256_permute2x128_si256(state02, state13, 0x31), mask));
+		outptr += 64;
+	}
+
+#undef TRANSFORM_VAES256
+}
+
+static void hashAndFillAes1Rx4_VAES256(void *scratchpad, size_t scratchpadSize, void *hash, void* fill_state) {
+	uint8_t* scratchpadPtr = (uint8_t*)scratchpad;
+	const uint8_t* scratchpadEnd = scratchpadPtr + scratchpadSize;
+
+	__m256i hash_state02 = _mm256_set_epi32(AES_HASH_1R_STATE2, AES_HASH_1R_STATE0);
+	__m256i hash_state13 = _mm256_set_epi32(AES_HASH_1R_STATE3, AES_HASH_1R_STATE1);
+
+	const __m256i key02 = _mm256_set_epi32(AES_GEN_1R_KEY2, AES_GEN_1R_KEY0);
+	const __m256i key13 = _mm256_set_epi32(AES_GEN_1R_KEY3, AES_GEN_1R_KEY1);
+
+	const __m256i fill_state01 = _mm256_loadu_si256((const __m256i*)fill_state + 0);
+	const __m256i fill_state23 = _mm256_loadu_si256((const __m256i*)fill_state + 1);
+	__m256i fill_state02 = _mm256_permute2x128_si256(fill_state01, fill_state23, 0x20);
+	__m256i fill_state13 = _mm256_permute2x128_si256(fill_state01, fill_state23, 0x31);
+
+	constexpr int PREFETCH_DISTANCE = 7168;
+	const char* prefetchPtr = ((const char*)scratchpad) + PREFETCH_DISTANCE;
+	scratchpadEnd -= PREFETCH_DISTANCE;
+
+	for (int i = 0; i < 2; ++i) {
+		//process 64 bytes at a time in 4 lanes
+		while (scratchpadPtr < scratchpadEnd) {
+			const __m256i in01 = _mm256_load_si256((const __m256i*)scratchpadPtr + 0);
+			const __m256i in23 = _mm256_load_si256((const __m256i*)scratchpadPtr + 1);
+
+			hash_state02 = _mm256_aesenc_epi128(hash_state02, _mm256_permute2x128_si256(in01, in23, 0x20));
+			hash_state13 = _mm256_aesdec_epi128(hash_state13, _mm256_permute2x128_si256(in01, in23, 0x31));
+
+			fill_state02 = _mm256_aesdec_epi128(fill_state02, key02);
+			fill_state13 = _mm256_aesenc_epi128(fill_state13, key13);
+
+			_mm256_store_si256((__m256i*)scratchpadPtr + 0, _mm256_permute2x128_si256(fill_state02, fill_state13, 0x20));
+			_mm256_store_si256((__m256i*)scratchpadPtr + 1, _mm256_permute2x128_si256(fill_state02, fill_state13, 0x31));
+
+			rx_prefetch_t0(prefetchPtr);
+
+			scratchpadPtr += 64;
+			prefetchPtr += 64;
+		}
+		prefetchPtr = (const char*) scratchpad;
+		scratchpadEnd += PREFETCH_DISTANCE;
+	}
+
+	_mm256_storeu_si256((__m256i*)fill_state + 0, _mm256_permute2x128_si256(fill_state02, fill_state13, 0x20));
+	_mm256_storeu_si256((__m256i*)fill_state + 1, _mm256_permute2x128_si256(fill_state02, fill_state13, 0x31));
+
+	hashAes1Rx4Final(hash_state02, hash_state13, hash);
+}
+
+#if defined(HAVE_AVX512F)
+static void hashAndFillAes1Rx4_VAES512(void *scratchpad, size_t scratchpadSize, void *hash, void* fill_state) {
+	uint8_t* scratchpadPtr = (uint8_t*)scratchpad;
+	const uint8_t* scratchpadEnd = scratchpadPtr + scratchpadSize;
+
+	// enc lanes are [hash 0, hash 2, fill 1, fill 3] and dec lanes are [hash 1, hash 3, fill 0, fill 2]
+	// (64-bit indexes below select them from one 64-byte block or from both vectors)
+	const __m512i in_idx_enc = _mm512_setr_epi64(0, 1, 4, 5, 0, 0, 0, 0);
+	const __m512i in_idx_dec = _mm512_setr_epi64(2, 3, 6, 7, 0, 0, 0, 0);
+	const __m512i fill_idx   = _mm512_setr_epi64(12, 13, 4, 5, 14, 15, 6, 7);
+	const __m512i fill_state0123 = _mm512_loadu_si512(fill_state);
+
+	__m512i enc = _mm512_set_epi32(0, 0, 0, 0, 0, 0, 0, 0, AES_HASH_1R_STATE2, AES_HASH_1R_STATE0);
+	__m512i dec = _mm512_set_epi32(0, 0, 0, 0, 0, 0, 0, 0, AES_HASH_1R_STATE3, AES_HASH_1R_STATE1);
+	enc = _mm512_mask_permutexvar_epi64(enc, 0xF0, _mm512_setr_epi64(0, 0, 0, 0, 2, 3, 6, 7), fill_state0123);
+	dec = _mm512_mask_permutexvar_epi64(dec, 0xF0, _mm512_setr_epi64(0, 0, 0, 0, 0, 1, 4, 5), fill_state0123);
+
+	const __m512i enc_key = _mm512_set_epi32(AES_GEN_1R_KEY3, AES_GEN_1R_KEY1, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m512i dec_key = _mm512_set_epi32(AES_GEN_1R_KEY2, AES_GEN_1R_KEY0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+	constexpr int PREFETCH_DISTANCE = 7168;
+	const char* prefetchPtr = ((const char*)scratchpad) + PREFETCH_DISTANCE;
+	scratchpadEnd -= PREFETCH_DISTANCE;
+
+	for (int i = 0; i < 2; ++i) {
+		//process 64 bytes at a time in 8 lanes (4 hash and 4 fill ones)
+		while (scratchpadPtr < scratchpadEnd) {
+			const __m512i in = _mm512_load_si512(scratchpadPtr);
+
+			enc = _mm512_aesenc_epi128(enc, _mm512_mask_permutexvar_epi64(enc_key, 0x0F, in_idx_enc, in));
+			dec = _mm512_aesdec_epi128(dec, _mm512_mask_permutexvar_epi64(dec_key, 0x0F, in_idx_dec, in));
+
+			_mm512_store_si512(scratchpadPtr, _mm512_permutex2var_epi64(enc, fill_idx, dec));
+
+			rx_prefetch_t0(prefetchPtr);
+
+			scratchpadPtr += 64;
+			prefetchPtr += 64;
+		}
+		prefetchPtr = (const char*) scratchpad;
+		scratchpadEnd += PREFETCH_DISTANCE;
+	}
+
+	_mm512_storeu_si512(fill_state, _mm512_permutex2var_epi64(enc, fill_idx, dec));
+
+	// maskz extract of all lanes since the plain cast and extract use undefined upper bits that GCC
+	// reports as maybe uninitialized
+	hashAes1Rx4Final(_mm512_maskz_extracti64x4_epi64(0xF, enc, 0), _mm512_maskz_extracti64x4_epi64(0xF, dec, 0), hash);
+}
+#endif
+#endif
+
 /*
 	Calculate a 512-bit hash of 'input' using 4 lanes of AES.
 	The input is treated as a set of round keys for the encryption
@@ -59,7 +256,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 	Hashing throughput: >20 GiB/s per CPU core with hardware AES
 */
 template<int softAes>
-void hashAes1Rx4(const void *input, size_t inputSize, void *hash) {
+static void hashAes1Rx4_AES(const void *input, size_t inputSize, void *hash) {
+
 	const uint8_t* inptr = (uint8_t*)input;
 	const uint8_t* inputEnd = inptr + inputSize;
 
@@ -108,14 +306,20 @@ void hashAes1Rx4(const void *input, size_t inputSize, void *hash) {
 	rx_store_vec_i128((rx_vec_i128*)hash + 3, state3);
 }
 
+template<int softAes>
+void hashAes1Rx4(const void *input, size_t inputSize, void *hash) {
+#	if defined(HAVE_VAES)
+	if (!softAes && hardAESImpl.load(std::memory_order_relaxed)) {
+		hashAes1Rx4_VAES256(input, inputSize, hash);
+		return;
+	}
+#	endif
+	hashAes1Rx4_AES<softAes>(input, inputSize, hash);
+}
+
 template void hashAes1Rx4<false>(const void *input, size_t inputSize, void *hash);
 template void hashAes1Rx4<true>(const void *input, size_t inputSize, void *hash);
 
-#define AES_GEN_1R_KEY0 0xb4f44917, 0xdbb5552b, 0x62716609, 0x6daca553
-#define AES_GEN_1R_KEY1 0x0da1dc4e, 0x1725d378, 0x846a710d, 0x6d7caf07
-#define AES_GEN_1R_KEY2 0x3e20e345, 0xf4c0794f, 0x9f947ec6, 0x3f1262f1
-#define AES_GEN_1R_KEY3 0x49169154, 0x16314c88, 0xb1ba317c, 0x6aef8135
-
 /*
 	Fill 'buffer' with pseudorandom data based on 512-bit 'state'.
 	The state is encrypted using a single AES round per 16 bytes of output
@@ -171,7 +375,8 @@ static constexpr randomx::Instruction inst{ 0xFF, 7, 7, 0xFF, 0xFFFFFFFFU };
 alignas(16) static const randomx::Instruction inst_mask[2] = { inst, inst };
 
 template<int softAes>
-void fillAes4Rx4(void *state, size_t outputSize, void *buffer) {
+static void fillAes4Rx4_AES(void *state, size_t outputSize, void *buffer) {
+
 	const uint8_t* outptr = (uint8_t*)buffer;
 	const uint8_t* outputEnd = outptr + outputSize;
 
@@ -232,13 +437,22 @@ void fillAes4Rx4(void *state, size_t outputSize, void *buffer) {
 	}
 }
 
+template<int softAes>
+void fillAes4Rx4(void *state, size_t outputSize, void *buffer) {
+#	if defined(HAVE_VAES)
+	if (!softAes && hardAESImpl.load(std::memory_order_relaxed)) {
+		fillAes4Rx4_VAES256(state, outputSize, buffer);
+		return;
+	}
+#	endif
+	fillAes4Rx4_AES<softAes>(state, outputSize, buffer);
+}
+
 template void fillAes4Rx4<true>(void *state, size_t outputSize, void *buffer);
 template void fillAes4Rx4<false>(void *state, size_t outputSize, void *buffer);
 
 template<int softAes, int unroll>
-void hashAndFillAes1Rx4(void *scratchpad, size_t scratchpadSize, void *hash, void* fill_state) {
-	PROFILE_SCOPE(RandomX_AES);
-
+static void hashAndFillAes1Rx4_AES(void *scratchpad, size_t scratchpadSize, void *hash, void* fill_state) {
 	uint8_t* scratchpadPtr = (uint8_t*)scratchpad;
 	const uint8_t* scratchpadEnd = scratchpadPtr + scratchpadSize;
 
@@ -376,6 +590,26 @@ void hashAndFillAes1Rx4(void *scratchpad, size_t scratchpadSize, void *hash, voi
 	rx_store_vec_i128((rx_vec_i128*)hash + 3, hash_state3);
 }
 
+template<int softAes, int unroll>
+void hashAndFillAes1Rx4(void *scratchpad, size_t scratchpadSize, void *hash, void* fill_state) {
+	PROFILE_SCOPE(RandomX_AES);
+
+#	if defined(HAVE_VAES)
+	const int impl = softAes ? 0 : hardAESImpl.load(std::memory_order_relaxed);
+	if (impl) {
+#		if defined(HAVE_AVX512F)
+		if (impl == 2) {
+			hashAndFillAes1Rx4_VAES512(scratchpad, scratchpadSize, hash, fill_state);
+			return;
+		}
+#		endif
+		hashAndFillAes1Rx4_VAES256(scratchpad, scratchpadSize, hash, fill_state);
+		return;
+	}
+#	endif
+	hashAndFillAes1Rx4_AES<softAes, unroll>(scratchpad, scratchpadSize, hash, fill_state);
+}
+
 template void hashAndFillAes1Rx4<0,2>(void* scratchpad, size_t scratchpadSize, void* hash, void* fill_state);
 template void hashAndFillAes1Rx4<1,1>(void* scratchpad, size_t scratchpadSize, void* hash, void* fill_state);
 template void hashAndFillAes1Rx4<2,1>(void* scratchpad, size_t scratchpadSize, void* hash, void* fill_state);
@@ -426,3 +660,41 @@ void SelectSoftAESImpl(size_t threadsCount)
   }
   softAESImpl = impl[fast_idx];
 }
+
+// limits hard AES impl to one that CPU supports
+static int GetSupportedHardAESImpl(int impl)
+{
+  const xmrig::ICpuInfo* const ci = xmrig::Cpu::info();
+# if defined(HAVE_VAES)
+# if defined(HAVE_AVX512F)
+  if (impl >= 2 && !ci->has(xmrig::ICpuInfo::FLAG_AVX512F)) impl = 1;
+# else
+  if (impl >= 2) impl = 1;
+# endif
+  if (impl >= 1 && !ci->hasVAES()) impl = 0;
+# else
+  impl = 0;
+# endif
+  if (impl < 0 || !ci->hasAES()) impl = 0;
+  return impl;
+}
+
+int SelectHardAESImpl(int impl)
+{
+  impl = GetSupportedHardAESImpl(impl);
+  hardAESImpl = impl;
+  return impl;
+}
+
+HardAESImpl GetHardAESImpl(int impl)
+{
+  switch (impl = GetSupportedHardAESImpl(impl)) {
+# if defined(HAVE_VAES)
+# if defined(HAVE_AVX512F)
+  case 2: return { impl, &hashAndFillAes1Rx4_VAES512, &hashAes1Rx4_VAES256, &fillAes4Rx4_VAES256 };
+# endif
+  case 1: return { impl, &hashAndFillAes1Rx4_VAES256, &hashAes1Rx4_VAES256, &fillAes4Rx4_VAES256 };
+# endif
+  default: return { impl, &hashAndFillAes1Rx4_AES<0, 2>, &hashAes1Rx4_AES<0>, &fillAes4Rx4_AES<0> };
+  }
+}
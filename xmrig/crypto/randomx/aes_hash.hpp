@@ -41,6 +41,25 @@ inline hashAndFillAes1Rx4_impl* GetSoftAESImpl()
 
 void SelectSoftAESImpl(size_t threadsCount);
 
+// selects hard AES functions: 0 - AES-NI, 1 - 256-bit VAES, 2 - 512-bit VAES (only
+// hashAndFillAes1Rx4 since others use 256-bit one), returns impl that CPU supports
+int SelectHardAESImpl(int impl);
+
+typedef void (hashAes1Rx4_impl)(const void *input, size_t inputSize, void *hash);
+typedef void (fillAes4Rx4_impl)(void *state, size_t outputSize, void *buffer);
+
+// hard AES functions of impl (limited to one that CPU supports) that are called without selecting
+// it, hashAndFill is hashAndFillAes1Rx4<0, 2> variant, hash and fill are hashAes1Rx4<0> and
+// fillAes4Rx4<0> ones
+struct HardAESImpl {
+  int impl;
+  hashAndFillAes1Rx4_impl* hashAndFill;
+  hashAes1Rx4_impl* hash;
+  fillAes4Rx4_impl* fill;
+};
+
+HardAESImpl GetHardAESImpl(int impl);
+
 template<int softAes>
 void hashAes1Rx4(const void *input, size_t inputSize, void *hash);
 
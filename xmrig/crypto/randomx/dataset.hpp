@@ -47,6 +47,7 @@ struct randomx_cache {
 	randomx::CacheInitializeFunc* initialize;
 	randomx::DatasetInitFunc* datasetInit;
 	randomx::SuperscalarProgram programs[RANDOMX_CACHE_MAX_ACCESSES];
+	RandomX_ConfigurationBase* rxConfig = nullptr; // set by randomx_init_cache
 
 	bool isInitialized() const {
 		return programs[0].getSize() != 0;
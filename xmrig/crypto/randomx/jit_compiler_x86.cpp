@@ -124,6 +124,12 @@ namespace randomx {
 	#define codeDatasetInitAVX2Epilogue ADDR(randomx_dataset_init_avx2_epilogue)
 	#define codeDatasetInitAVX2SshLoad ADDR(randomx_dataset_init_avx2_ssh_load)
 	#define codeDatasetInitAVX2SshPrefetch ADDR(randomx_dataset_init_avx2_ssh_prefetch)
+	#define codeDatasetInitAVX512Prologue ADDR(randomx_dataset_init_avx512_prologue)
+	#define codeDatasetInitAVX512LoopBegin ADDR(randomx_dataset_init_avx512_loop_begin)
+	#define codeDatasetInitAVX512LoopEnd ADDR(randomx_dataset_init_avx512_loop_end)
+	#define codeDatasetInitAVX512Epilogue ADDR(randomx_dataset_init_avx512_epilogue)
+	#define codeDatasetInitAVX512SshLoad ADDR(randomx_dataset_init_avx512_ssh_load)
+	#define codeDatasetInitAVX512SshPrefetch ADDR(randomx_dataset_init_avx512_ssh_prefetch)
 	#define codeLoopStore ADDR(randomx_program_loop_store)
 	#define codeLoopEnd ADDR(randomx_program_loop_end)
 	#define codeEpilogue ADDR(randomx_program_epilogue)
@@ -145,7 +151,13 @@ namespace randomx {
 	#define datasetInitAVX2LoopEndSize (codeDatasetInitAVX2Epilogue - codeDatasetInitAVX2LoopEnd)
 	#define datasetInitAVX2EpilogueSize (codeDatasetInitAVX2SshLoad - codeDatasetInitAVX2Epilogue)
 	#define datasetInitAVX2SshLoadSize (codeDatasetInitAVX2SshPrefetch - codeDatasetInitAVX2SshLoad)
-	#define datasetInitAVX2SshPrefetchSize (codeEpilogue - codeDatasetInitAVX2SshPrefetch)
+	#define datasetInitAVX2SshPrefetchSize (codeDatasetInitAVX512Prologue - codeDatasetInitAVX2SshPrefetch)
+	#define datasetInitAVX512PrologueSize (codeDatasetInitAVX512LoopEnd - codeDatasetInitAVX512Prologue)
+	#define datasetInitAVX512LoopBeginOffset (codeDatasetInitAVX512LoopBegin - codeDatasetInitAVX512Prologue)
+	#define datasetInitAVX512LoopEndSize (codeDatasetInitAVX512Epilogue - codeDatasetInitAVX512LoopEnd)
+	#define datasetInitAVX512EpilogueSize (codeDatasetInitAVX512SshLoad - codeDatasetInitAVX512Epilogue)
+	#define datasetInitAVX512SshLoadSize (codeDatasetInitAVX512SshPrefetch - codeDatasetInitAVX512SshLoad)
+	#define datasetInitAVX512SshPrefetchSize (codeEpilogue - codeDatasetInitAVX512SshPrefetch)
 	#define epilogueSize (codeSshLoad - codeEpilogue)
 	#define codeSshLoadSize (codeSshPrefetch - codeSshLoad)
 	#define codeSshPrefetchSize (codeSshEnd - codeSshPrefetch)
@@ -280,9 +292,15 @@ namespace randomx {
 			initDatasetAVX2 = false;
 		}
 
+		// AVX-512 dataset init is only used when it is requested (optimizedDatasetInit = 2)
+		initDatasetAVX512 = optimizedInitDatasetEnable && (optimizedDatasetInit > 1) && xmrig::Cpu::info()->has(xmrig::ICpuInfo::FLAG_AVX512F);
+		if (initDatasetAVX512) {
+			initDatasetAVX2 = false;
+		}
+
 		hasXOP = xmrig::Cpu::info()->hasXOP();
 
-		allocatedSize = initDatasetAVX2 ? (CodeSize * 4) : (CodeSize * 2);
+		allocatedSize = initDatasetAVX512 ? (CodeSize * 5) : (initDatasetAVX2 ? (CodeSize * 4) : (CodeSize * 2));
 		allocatedCode = static_cast<uint8_t*>(allocExecutableMemory(allocatedSize,
 #			ifdef XMRIG_SECURE_JIT
 			false
@@ -327,7 +345,6 @@ namespace randomx {
 	template<typename T> static FORCE_INLINE void prefetch_data(const T& data) { prefetch_data<(sizeof(T) + 63) / 64>(&data); }
 
 	void JitCompilerX86::prepare() {
-		prefetch_data(engine);
 		prefetch_data(RandomX_CurrentConfig);
 	}
 
@@ -360,6 +377,34 @@ namespace randomx {
 	template<size_t N>
 	void JitCompilerX86::generateSuperscalarHash(SuperscalarProgram(&programs)[N]) {
 		uint8_t* p = code;
+		if (initDatasetAVX512) {
+			codePos = 0;
+			emit(codeDatasetInitAVX512Prologue, datasetInitAVX512PrologueSize, code, codePos);
+
+			for (unsigned j = 0; j < RandomX_CurrentConfig.CacheAccesses; ++j) {
+				SuperscalarProgram& prog = programs[j];
+				for (uint32_t i = 0, n = prog.getSize(); i < n; ++i) {
+					generateSuperscalarCodeAVX512(prog(i), code, codePos);
+				}
+				emit(codeSshLoad, codeSshLoadSize, code, codePos);
+				emit(codeDatasetInitAVX512SshLoad, datasetInitAVX512SshLoadSize, code, codePos);
+				if (j < RandomX_CurrentConfig.CacheAccesses - 1) {
+					*(uint32_t*)(code + codePos) = 0xd88b49 + (static_cast<uint32_t>(prog.getAddressRegister()) << 16);
+					codePos += 3;
+					emit(RandomX_CurrentConfig.codeSshPrefetchTweaked, codeSshPrefetchSize, code, codePos);
+					uint8_t* p = code + codePos;
+					emit(codeDatasetInitAVX512SshPrefetch, datasetInitAVX512SshPrefetchSize, code, codePos);
+					p[5] += prog.getAddressRegister();
+				}
+			}
+
+			emit(codeDatasetInitAVX512LoopEnd, datasetInitAVX512LoopEndSize, code, codePos);
+			*(int32_t*)(code + codePos - 4) = static_cast<int32_t>(datasetInitAVX512LoopBeginOffset) - static_cast<int32_t>(codePos);
+
+			emit(codeDatasetInitAVX512Epilogue, datasetInitAVX512EpilogueSize, code, codePos);
+			return;
+		}
+
 		if (initDatasetAVX2) {
 			codePos = 0;
 			emit(codeDatasetInitAVX2Prologue, datasetInitAVX2PrologueSize, code, codePos);
@@ -416,8 +461,8 @@ namespace randomx {
 	void JitCompilerX86::generateSuperscalarHash(SuperscalarProgram(&programs)[RANDOMX_CACHE_MAX_ACCESSES]);
 
 	void JitCompilerX86::generateDatasetInitCode() {
-		// AVX2 code is generated in generateSuperscalarHash()
-		if (!initDatasetAVX2) {
+		// AVX2 and AVX-512 code is generated in generateSuperscalarHash()
+		if (!initDatasetAVX2 && !initDatasetAVX512) {
 			memcpy(code, codeDatasetInit, datasetInitSize);
 		}
 	}
@@ -451,6 +496,9 @@ namespace randomx {
 			r[j] = k;
 		}
 
+		static_assert(sizeof(InstructionGeneratorX86) == sizeof(RandomX_CurrentConfig.JitCompilerX86Engine[0]), "Unexpected JIT engine size");
+		const InstructionGeneratorX86* engine = reinterpret_cast<const InstructionGeneratorX86*>(RandomX_CurrentConfig.JitCompilerX86Engine);
+
 		for (int i = 0, n = static_cast<int>(RandomX_CurrentConfig.ProgramSize); i < n; i += 4) {
 			Instruction& instr1 = prog(i);
 			Instruction& instr2 = prog(i + 1);
@@ -738,6 +786,141 @@ namespace randomx {
 	template void JitCompilerX86::generateSuperscalarCode<false>(Instruction&, uint8_t*, uint32_t&);
 	template void JitCompilerX86::generateSuperscalarCode<true>(Instruction&, uint8_t*, uint32_t&);
 
+	// Integer registers (lane 0) use the same code as generateSuperscalarCode<false>, zmm0-7 (lanes 1-8)
+	// use zmm8-13 as temporary registers and zmm31 = 0xFFFFFFFF in each 64-bit element
+	FORCE_INLINE void JitCompilerX86::generateSuperscalarCodeAVX512(Instruction& instr, uint8_t* code, uint32_t& codePos) {
+		enum { VPSHIFTQ = 0x73, VPSHIFTQ2 = 0x72, VPANDQ = 0xDB, VPADDQ = 0xD4, VPMULUDQ = 0xF4, VPXORQ = 0xEF, VPSUBQ = 0xFB };
+		enum { SRL = 2, SLL = 6, SRA = 4, ROR = 0 };
+		enum { T0 = 8, T1, T2, T3, T4, T5, MASK32 = 31 };
+
+		const uint32_t dst = instr.dst;
+		const uint32_t src = instr.src;
+		const uint32_t start = codePos;
+
+		switch ((SuperscalarInstructionType)instr.opcode)
+		{
+		case randomx::SuperscalarInstructionType::IADD_C7:
+		case randomx::SuperscalarInstructionType::IADD_C8:
+		case randomx::SuperscalarInstructionType::IADD_C9:
+		case randomx::SuperscalarInstructionType::IXOR_C7:
+		case randomx::SuperscalarInstructionType::IXOR_C8:
+		case randomx::SuperscalarInstructionType::IXOR_C9:
+			// mov rax, imm64 (it is broadcast to zmm lanes from the code)
+			*(uint32_t*)(code + codePos) = 0xB848;
+			codePos += 2;
+			emit64(signExtend2sCompl(instr.getImm32()), code, codePos);
+			break;
+		default:
+			generateSuperscalarCode<false>(instr, code, codePos);
+			break;
+		}
+
+		switch ((SuperscalarInstructionType)instr.opcode)
+		{
+		case randomx::SuperscalarInstructionType::ISUB_R:
+			emitEVEX(VPSUBQ, dst, dst, src, code, codePos);
+			break;
+		case randomx::SuperscalarInstructionType::IXOR_R:
+			emitEVEX(VPXORQ, dst, dst, src, code, codePos);
+			break;
+		case randomx::SuperscalarInstructionType::IADD_RS:
+			if (instr.getModShift()) {
+				emitEVEX(VPSHIFTQ, SLL, T0, src, code, codePos);
+				emitByte(instr.getModShift(), code, codePos);
+				emitEVEX(VPADDQ, dst, dst, T0, code, codePos);
+			}
+			else {
+				emitEVEX(VPADDQ, dst, dst, src, code, codePos);
+			}
+			break;
+		case randomx::SuperscalarInstructionType::IMUL_R:
+			// dst = dst_lo * src_lo + ((dst_hi * src_lo + dst_lo * src_hi) << 32)
+			emitEVEX(VPSHIFTQ, SRL, T0, dst, code, codePos);
+			emitByte(32, code, codePos);
+			emitEVEX(VPSHIFTQ, SRL, T1, src, code, codePos);
+			emitByte(32, code, codePos);
+			emitEVEX(VPMULUDQ, T0, T0, src, code, codePos);
+			emitEVEX(VPMULUDQ, T1, T1, dst, code, codePos);
+			emitEVEX(VPADDQ, T0, T0, T1, code, codePos);
+			emitEVEX(VPSHIFTQ, SLL, T0, T0, code, codePos);
+			emitByte(32, code, codePos);
+			emitEVEX(VPMULUDQ, dst, dst, src, code, codePos);
+			emitEVEX(VPADDQ, dst, dst, T0, code, codePos);
+			break;
+		case randomx::SuperscalarInstructionType::IROR_C:
+			emitEVEX(VPSHIFTQ2, ROR, dst, dst, code, codePos);
+			emitByte(instr.getImm32() & 63, code, codePos);
+			break;
+		case randomx::SuperscalarInstructionType::IADD_C7:
+		case randomx::SuperscalarInstructionType::IADD_C8:
+		case randomx::SuperscalarInstructionType::IADD_C9:
+			// add r8+dst, rax
+			emitByte(0x4C, code, codePos);
+			emitByte(0x03, code, codePos);
+			emitByte(0xC0 + (dst << 3), code, codePos);
+			emitEVEX(VPADDQ, dst, dst, -1, code, codePos, start + 2);
+			break;
+		case randomx::SuperscalarInstructionType::IXOR_C7:
+		case randomx::SuperscalarInstructionType::IXOR_C8:
+		case randomx::SuperscalarInstructionType::IXOR_C9:
+			// xor r8+dst, rax
+			emitByte(0x4C, code, codePos);
+			emitByte(0x33, code, codePos);
+			emitByte(0xC0 + (dst << 3), code, codePos);
+			emitEVEX(VPXORQ, dst, dst, -1, code, codePos, start + 2);
+			break;
+		case randomx::SuperscalarInstructionType::IMULH_R:
+		case randomx::SuperscalarInstructionType::ISMULH_R:
+			// unsigned high part: dst_hi * src_hi + (t >> 32) + (u >> 32), where
+			// t = dst_hi * src_lo + ((dst_lo * src_lo) >> 32) and u = dst_lo * src_hi + (t & 0xFFFFFFFF)
+			emitEVEX(VPSHIFTQ, SRL, T0, dst, code, codePos);
+			emitByte(32, code, codePos);
+			emitEVEX(VPSHIFTQ, SRL, T1, src, code, codePos);
+			emitByte(32, code, codePos);
+			emitEVEX(VPMULUDQ, T2, dst, src, code, codePos);
+			emitEVEX(VPMULUDQ, T3, T0, src, code, codePos);
+			emitEVEX(VPMULUDQ, T4, dst, T1, code, codePos);
+			emitEVEX(VPMULUDQ, T0, T0, T1, code, codePos);
+			emitEVEX(VPSHIFTQ, SRL, T2, T2, code, codePos);
+			emitByte(32, code, codePos);
+			emitEVEX(VPADDQ, T3, T3, T2, code, codePos);
+			emitEVEX(VPANDQ, T2, T3, MASK32, code, codePos);
+			emitEVEX(VPADDQ, T4, T4, T2, code, codePos);
+			emitEVEX(VPSHIFTQ, SRL, T3, T3, code, codePos);
+			emitByte(32, code, codePos);
+			emitEVEX(VPSHIFTQ, SRL, T4, T4, code, codePos);
+			emitByte(32, code, codePos);
+			emitEVEX(VPADDQ, T0, T0, T3, code, codePos);
+			if ((SuperscalarInstructionType)instr.opcode == randomx::SuperscalarInstructionType::ISMULH_R) {
+				// signed high part: unsigned one - (dst < 0 ? src : 0) - (src < 0 ? dst : 0)
+				emitEVEX(VPSHIFTQ2, SRA, T5, dst, code, codePos);
+				emitByte(63, code, codePos);
+				emitEVEX(VPANDQ, T5, T5, src, code, codePos);
+				emitEVEX(VPSHIFTQ2, SRA, T1, src, code, codePos);
+				emitByte(63, code, codePos);
+				emitEVEX(VPANDQ, T1, T1, dst, code, codePos);
+				emitEVEX(VPSUBQ, T0, T0, T5, code, codePos);
+				emitEVEX(VPSUBQ, T0, T0, T1, code, codePos);
+			}
+			emitEVEX(VPADDQ, dst, T0, T4, code, codePos);
+			break;
+		case randomx::SuperscalarInstructionType::IMUL_RCP:
+			// reciprocal is read from mov rax, imm64 (its high half from imm64 + 4 for vpmuludq)
+			emitEVEX(VPSHIFTQ, SRL, T0, dst, code, codePos);
+			emitByte(32, code, codePos);
+			emitEVEX(VPMULUDQ, T0, T0, -1, code, codePos, start + 2);
+			emitEVEX(VPMULUDQ, T1, dst, -1, code, codePos, start + 6);
+			emitEVEX(VPADDQ, T0, T0, T1, code, codePos);
+			emitEVEX(VPSHIFTQ, SLL, T0, T0, code, codePos);
+			emitByte(32, code, codePos);
+			emitEVEX(VPMULUDQ, dst, dst, -1, code, codePos, start + 2);
+			emitEVEX(VPADDQ, dst, dst, T0, code, codePos);
+			break;
+		default:
+			UNREACHABLE;
+		}
+	}
+
 	template<bool rax>
 	FORCE_INLINE void JitCompilerX86::genAddressReg(const Instruction& instr, const uint32_t src, uint8_t* code, uint32_t& codePos) {
 		*(uint32_t*)(code + codePos) = (rax ? 0x24808d41 : 0x24888d41) + (src << 16);
@@ -1447,6 +1630,4 @@ namespace randomx {
 		emitByte(0x90, code, codePos);
 	}
 
-	alignas(64) InstructionGeneratorX86 JitCompilerX86::engine[256] = {};
-
 }
@@ -81,8 +81,6 @@ namespace randomx {
 		void enableWriting() const;
 		void enableExecution() const;
 
-		alignas(64) static InstructionGeneratorX86 engine[256];
-
 	private:
 		int registerUsage[RegistersCount] = {};
 		uint8_t* code = nullptr;
@@ -100,6 +98,7 @@ namespace randomx {
 		bool hasAVX;
 		bool hasAVX2;
 		bool initDatasetAVX2;
+		bool initDatasetAVX512;
 		bool hasXOP;
 
 		uint8_t* allocatedCode = nullptr;
@@ -118,6 +117,7 @@ namespace randomx {
 
 		template<bool AVX2>
 		void generateSuperscalarCode(Instruction& inst, uint8_t* code, uint32_t& codePos);
+		void generateSuperscalarCodeAVX512(Instruction& inst, uint8_t* code, uint32_t& codePos);
 
 		static void emitByte(uint8_t val, uint8_t* code, uint32_t& codePos) {
 			code[codePos] = val;
@@ -144,6 +144,24 @@ namespace randomx {
 			codePos += count;
 		}
 
+		// EVEX.512.66.0F.W1 instruction with zmm(reg), zmm(vvvv) and zmm(rm) operands or
+		// qword ptr [rip + disp32]{1to8} one (rm < 0) that reads 8 bytes at code + target
+		static void emitEVEX(uint32_t opcode, uint32_t reg, uint32_t vvvv, int32_t rm, uint8_t* code, uint32_t& codePos, uint32_t target = 0) {
+			const uint32_t b = (rm < 0) ? 0 : rm;
+			emitByte(0x62, code, codePos);
+			emitByte(((~reg & 8) << 4) | ((~b & 16) << 2) | ((~b & 8) << 2) | (~reg & 16) | 0x01, code, codePos);
+			emitByte(0x85 | ((~vvvv & 15) << 3), code, codePos);
+			emitByte(((rm < 0) ? 0x50 : 0x40) | ((~vvvv & 16) >> 1), code, codePos);
+			emitByte(opcode, code, codePos);
+			if (rm < 0) {
+				emitByte(0x05 | ((reg & 7) << 3), code, codePos);
+				emit32(target - (codePos + 4), code, codePos);
+			}
+			else {
+				emitByte(0xC0 | ((reg & 7) << 3) | (b & 7), code, codePos);
+			}
+		}
+
 	public:
 		void h_IADD_RS(const Instruction&);
 		void h_IADD_M(const Instruction&);
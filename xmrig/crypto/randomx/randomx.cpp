@@ -43,6 +43,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "backend/cpu/Cpu.h"
 #include "crypto/common/VirtualMemory.h"
+#include <atomic>
+#include <map>
 #include <mutex>
 
 #include <cassert>
@@ -194,7 +196,7 @@ RandomX_ConfigurationBase::RandomX_ConfigurationBase()
 static uint32_t Log2(size_t value) { return (value > 1) ? (Log2(value / 2) + 1) : 0; }
 #endif
 
-static int scratchpadPrefetchMode = 1;
+static std::atomic<int> scratchpadPrefetchMode{1};
 
 void randomx_set_scratchpad_prefetch_mode(int mode)
 {
@@ -232,7 +234,7 @@ void RandomX_ConfigurationBase::Apply()
 		uint32_t* a = (uint32_t*)(codePrefetchScratchpadTweaked + (hasBMI2 ? 11 : 8));
 		uint32_t* b = (uint32_t*)(codePrefetchScratchpadTweaked + (hasBMI2 ? 21 : 22));
 
-		switch (scratchpadPrefetchMode)
+		switch (ScratchpadPrefetchMode)
 		{
 		case 0:
 			*a = 0x00401F0FUL; // 4-byte nop
@@ -261,7 +263,7 @@ typedef void(randomx::JitCompilerX86::* InstructionGeneratorX86_2)(const randomx
 
 #define JIT_HANDLE(x, prev) do { \
 		const InstructionGeneratorX86_2 p = &randomx::JitCompilerX86::h_##x; \
-		memcpy(randomx::JitCompilerX86::engine + k, &p, sizeof(randomx::JitCompilerX86::engine[k])); \
+		memcpy(JitCompilerX86Engine + k, &p, sizeof(JitCompilerX86Engine[k])); \
 	} while (0)
 
 #elif (XMRIG_ARM == 8)
@@ -360,7 +362,51 @@ RandomX_ConfigurationGraft RandomX_GraftConfig;
 RandomX_ConfigurationSafex RandomX_SafexConfig;
 RandomX_ConfigurationYada RandomX_YadaConfig;
 
-alignas(64) RandomX_ConfigurationBase RandomX_CurrentConfig;
+thread_local RandomX_ConfigurationBase* RandomX_CurrentConfigPtr = &RandomX_MoneroConfig;
+
+static std::mutex config_mutex;
+
+// Applied copies of configurations by source configuration and scratchpad prefetch mode. A copy is
+// applied before it is published and never changed or freed, since caches, VMs and other threads
+// keep pointers to it.
+static std::map<std::pair<const RandomX_ConfigurationBase*, int>, RandomX_ConfigurationBase*> appliedConfigs;
+
+void randomx_select_config(const RandomX_ConfigurationBase& config)
+{
+	const RandomX_ConfigurationBase* source = config.SourceConfig ? config.SourceConfig : &config;
+	const int mode = scratchpadPrefetchMode;
+
+	std::lock_guard<std::mutex> lock(config_mutex);
+	RandomX_ConfigurationBase*& applied = appliedConfigs[{ source, mode }];
+	if (!applied) {
+		RandomX_ConfigurationBase* copy = new RandomX_ConfigurationBase(*source);
+		copy->SourceConfig = source;
+		copy->ScratchpadPrefetchMode = mode;
+		copy->Apply();
+		applied = copy;
+	}
+	RandomX_CurrentConfigPtr = applied;
+}
+
+namespace {
+
+// selects configuration of a cache or VM for the current thread while it is in scope
+class ScopedConfig
+{
+public:
+	explicit ScopedConfig(RandomX_ConfigurationBase* config) : m_prev(RandomX_CurrentConfigPtr)
+	{
+		if (config) {
+			RandomX_CurrentConfigPtr = config;
+		}
+	}
+	~ScopedConfig() { RandomX_CurrentConfigPtr = m_prev; }
+
+private:
+	RandomX_ConfigurationBase* m_prev;
+};
+
+} // namespace
 
 static std::mutex vm_pool_mutex;
 
@@ -407,6 +453,7 @@ extern "C" {
 	void randomx_init_cache(randomx_cache *cache, const void *key, size_t keySize) {
 		assert(cache != nullptr);
 		assert(keySize == 0 || key != nullptr);
+		cache->rxConfig = RandomX_CurrentConfigPtr;
 		cache->initialize(cache, key, keySize);
 	}
 
@@ -437,6 +484,7 @@ extern "C" {
 		assert(cache != nullptr);
 		assert(startItem < DatasetItemCount && itemCount <= DatasetItemCount);
 		assert(startItem + itemCount <= DatasetItemCount);
+		ScopedConfig config(cache->rxConfig);
 		cache->datasetInit(cache, dataset->memory + startItem * randomx::CacheLineSize, startItem, startItem + itemCount);
 	}
 
@@ -524,6 +572,8 @@ extern "C" {
 					UNREACHABLE;
 			}
 
+			vm->rxConfig = RandomX_CurrentConfigPtr;
+
 			if (cache != nullptr) {
 				vm->setCache(cache);
 			}
@@ -552,6 +602,7 @@ extern "C" {
 	void randomx_vm_set_cache(randomx_vm *machine, randomx_cache* cache) {
 		assert(machine != nullptr);
 		assert(cache != nullptr && cache->isInitialized());
+		ScopedConfig config(machine->rxConfig);
 		machine->setCache(cache);
 	}
 
@@ -561,6 +612,12 @@ extern "C" {
 		machine->setDataset(dataset);
 	}
 
+	void randomx_vm_set_scratchpad(randomx_vm *machine, uint8_t *scratchpad) {
+		assert(machine != nullptr);
+		assert(scratchpad != nullptr);
+		machine->setScratchpad(scratchpad);
+	}
+
 	void randomx_destroy_vm(randomx_vm* vm) {
 		vm->~randomx_vm();
 	}
@@ -569,6 +626,7 @@ extern "C" {
 		assert(machine != nullptr);
 		assert(inputSize == 0 || input != nullptr);
 		assert(output != nullptr);
+		ScopedConfig config(machine->rxConfig);
 		alignas(16) uint64_t tempHash[8];
 		rx_blake2b_wrapper::run(tempHash, sizeof(tempHash), input, inputSize);
 		machine->initScratchpad(&tempHash);
@@ -582,12 +640,14 @@ extern "C" {
 	}
 
 	void randomx_calculate_hash_first(randomx_vm* machine, uint64_t (&tempHash)[8], const void* input, size_t inputSize) {
+		ScopedConfig config(machine->rxConfig);
 		rx_blake2b_wrapper::run(tempHash, sizeof(tempHash), input, inputSize);
 		machine->initScratchpad(tempHash);
 	}
 
 	void randomx_calculate_hash_next(randomx_vm* machine, uint64_t (&tempHash)[8], const void* nextInput, size_t nextInputSize, void* output) {
 		PROFILE_SCOPE(RandomX_hash);
+		ScopedConfig config(machine->rxConfig);
 
 		machine->resetRoundingMode();
 		for (uint32_t chain = 0; chain < RandomX_CurrentConfig.ProgramCount - 1; ++chain) {
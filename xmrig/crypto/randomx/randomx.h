@@ -133,6 +133,15 @@ struct RandomX_ConfigurationBase
 	uint32_t ScratchpadL3Mask_Calculated;
 	uint32_t ScratchpadL3Mask64_Calculated;
 
+	// Set on the applied copies made by randomx_select_config, which are never changed afterwards
+	const RandomX_ConfigurationBase* SourceConfig = nullptr;
+	int ScratchpadPrefetchMode = -1;
+
+#	if defined(XMRIG_FEATURE_ASM) && (defined(_M_X64) || defined(__x86_64__))
+	// randomx::JitCompilerX86 instruction generators for instruction frequencies of this configuration
+	alignas(64) uintptr_t JitCompilerX86Engine[256];
+#	endif
+
 #	if (XMRIG_ARM == 8)
 	uint32_t Log2_ScratchpadL1;
 	uint32_t Log2_ScratchpadL2;
@@ -156,15 +165,20 @@ extern RandomX_ConfigurationGraft RandomX_GraftConfig;
 extern RandomX_ConfigurationSafex RandomX_SafexConfig;
 extern RandomX_ConfigurationYada RandomX_YadaConfig;
 
-extern RandomX_ConfigurationBase RandomX_CurrentConfig;
+// Configuration used by RandomX code in the current thread. It is selected by randomx_apply_config
+// and by randomx_* functions from the configuration of the cache or VM they are called with, so
+// different threads can use different RandomX variants at the same time.
+extern thread_local RandomX_ConfigurationBase* RandomX_CurrentConfigPtr;
+#define RandomX_CurrentConfig (*RandomX_CurrentConfigPtr)
+
+void randomx_select_config(const RandomX_ConfigurationBase& config);
 
 template<typename T>
 void randomx_apply_config(const T& config)
 {
 	static_assert(sizeof(T) == sizeof(RandomX_ConfigurationBase), "Invalid RandomX configuration struct size");
 	static_assert(std::is_base_of<RandomX_ConfigurationBase, T>::value, "Incompatible RandomX configuration struct");
-	RandomX_CurrentConfig = config;
-	RandomX_CurrentConfig.Apply();
+	randomx_select_config(config);
 }
 
 void randomx_set_scratchpad_prefetch_mode(int mode);
@@ -297,6 +311,14 @@ RANDOMX_EXPORT void randomx_vm_set_cache(randomx_vm *machine, randomx_cache* cac
 */
 RANDOMX_EXPORT void randomx_vm_set_dataset(randomx_vm *machine, randomx_dataset *dataset);
 
+/**
+ * Moves scratchpad of a virtual machine to new memory (its content is not copied).
+ *
+ * @param machine is a pointer to a randomx_vm structure. Must not be NULL.
+ * @param scratchpad is a pointer to the new scratchpad memory. Must not be NULL.
+*/
+RANDOMX_EXPORT void randomx_vm_set_scratchpad(randomx_vm *machine, uint8_t *scratchpad);
+
 /**
  * Releases all memory occupied by the randomx_vm structure.
  *
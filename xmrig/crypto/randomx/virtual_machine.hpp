@@ -46,6 +46,8 @@ public:
 	virtual void run(void* seed) = 0;
 	void resetRoundingMode();
 
+	RandomX_ConfigurationBase* rxConfig = nullptr; // set by randomx_create_vm
+
 	void setFlags(uint32_t flags) { vm_flags = flags; }
 	uint32_t getFlags() const { return vm_flags; }
 